@@ -0,0 +1,9 @@
+// Buffer cache statistics returned by bcachestat().
+// Both the kernel and user programs use this header file.
+
+struct bcacheinfo {
+  int nbuf;               // Buffers now in the cache
+  int maxbuf;             // Most it may grow to (NBUFMAX)
+  uint hits;              // Lookups found in the cache
+  uint misses;            // Lookups that had to recycle a buffer
+};
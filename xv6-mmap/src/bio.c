@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -21,75 +21,376 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "mmu.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "proc.h"
+#include "percpu.h"
+#include "bcacheinfo.h"
+
+// Buffers are found through a hash table on (dev, blockno),
+// each bucket with its own lock, so cache hits on different
+// blocks do not contend.  Releasing the last reference
+// stamps a buffer with the time, under its bucket lock only;
+// a miss recycles the unused buffer with the oldest stamp.
+//
+// The cache starts with NBUF buffers and grows on misses, one
+// chunk of NBPC buffers at a time, while free memory stays
+// above BCACHELOWAT pages or no buffer can be recycled, up to
+// NBUFMAX buffers.  Failing both, a miss waits for a release.  When
+// kalloc() runs out of pages it calls bshrink(), which frees
+// a grown chunk none of whose buffers is in use.
+//
+// Locking: a bucket's lock protects its chain and the dev,
+// blockno, refcnt and lastuse of the buffers on it.
+// bcache.lock protects the chunk list and serializes
+// recycling, so dev and blockno change only under it; it is
+// taken before a bucket lock, never while holding one.
+
+#define NBUCKET 31
+#define BHASH(dev, blockno) (((dev) * 7 + (blockno)) % NBUCKET)
+
+#define NBPC 16                 // Buffers per chunk
+#define BPP  (PGSIZE/BSIZE)     // Blocks per data page
+
+struct bucket {
+  struct spinlock lock;
+  struct buf *head;             // Chain through hnext
+} __attribute__((aligned(CACHELINE)));
+
+// A chunk fills one page; its buffers' data are in page[].
+struct bchunk {
+  struct bchunk *next;
+  int fixed;                    // Allocated by binit(), never freed
+  char *page[NBPC/BPP];
+  struct buf buf[NBPC];
+};
 
 struct {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct bchunk *chunks;
+  int nbuf;
+  int nwait;                    // bget()s waiting for a free buffer
 
-  // Linked list of all buffers, through prev/next.
-  // head.next is most recently used.
-  struct buf head;
-} bcache;
+  struct bucket bucket[NBUCKET];
+} __attribute__((aligned(CACHELINE))) bcache;
+
+static DEFINE_PERCPU(uint, bhits);
+static DEFINE_PERCPU(uint, bmisses);
+
+static int bgrow(int);
+static void bput(struct buf*);
 
 void
 binit(void)
 {
-  struct buf *b;
+  struct bucket *bk;
 
   initlock(&bcache.lock, "bcache");
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++)
+    initlock(&bk->lock, "bcache.bucket");
 
 //PAGEBREAK!
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
+  while(bcache.nbuf < NBUF)
+    if(bgrow(1) < 0)
+      panic("binit");
+}
+
+// Add a chunk of free buffers to the cache, hashed as block 0
+// of the unused device 0 and stamped 0 so that they are
+// recycled first.
+static int
+bgrow(int fixed)
+{
+  struct bchunk *c;
+  struct bucket *bk;
+  struct buf *b;
+  int i;
+
+  if(sizeof(struct bchunk) > PGSIZE)
+    panic("bgrow: chunk too big");
+  if((c = (struct bchunk*)kalloc()) == 0)
+    return -1;
+  memset(c, 0, PGSIZE);
+  for(i = 0; i < NELEM(c->page); i++){
+    if((c->page[i] = kalloc()) == 0){
+      while(--i >= 0)
+        kfree(c->page[i]);
+      kfree((char*)c);
+      return -1;
+    }
+  }
+  c->fixed = fixed;
+  for(b = c->buf; b < c->buf+NBPC; b++){
+    i = b - c->buf;
+    b->data = (uchar*)c->page[i/BPP] + (i%BPP)*BSIZE;
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
   }
+
+  acquire(&bcache.lock);
+  if(!fixed && bcache.nbuf >= NBUFMAX){
+    // Another process grew it first.
+    release(&bcache.lock);
+    for(i = 0; i < NELEM(c->page); i++)
+      kfree(c->page[i]);
+    kfree((char*)c);
+    return -1;
+  }
+  bk = &bcache.bucket[BHASH(0, 0)];
+  acquire(&bk->lock);
+  for(b = c->buf; b < c->buf+NBPC; b++){
+    b->hnext = bk->head;
+    bk->head = b;
+  }
+  release(&bk->lock);
+  c->next = bcache.chunks;
+  bcache.chunks = c;
+  bcache.nbuf += NBPC;
+  release(&bcache.lock);
+  return 0;
+}
+
+// Find the cached buffer for the block and take a reference.
+// Caller holds bk->lock.
+static struct buf*
+bfind(struct bucket *bk, uint dev, uint blockno)
+{
+  struct buf *b;
+
+  for(b = bk->head; b; b = b->hnext){
+    if(b->dev == dev && b->blockno == blockno){
+      b->refcnt++;
+      return b;
+    }
+  }
+  return 0;
+}
+
+// Take b out of its hash chain.  Caller holds bk->lock.
+static void
+bunhash(struct bucket *bk, struct buf *b)
+{
+  struct buf **pp;
+
+  for(pp = &bk->head; *pp != b; pp = &(*pp)->hnext)
+    ;
+  *pp = b->hnext;
+}
+
+// Return the unused buffer released longest ago, or 0.
+// Even if refcnt==0, B_DIRTY indicates a buffer is in use
+// because log.c has modified it but not yet committed it.
+// Caller holds bcache.lock, which keeps dev and blockno
+// stable; refcnt may change, so the caller must check it.
+static struct buf*
+boldest(void)
+{
+  struct bchunk *c;
+  struct buf *b, *old;
+  uint now;
+
+  now = ticks;
+  old = 0;
+  for(c = bcache.chunks; c; c = c->next){
+    for(b = c->buf; b < c->buf+NBPC; b++){
+      if(b->refcnt != 0 || (b->flags & B_DIRTY))
+        continue;
+      if(old == 0 || now - b->lastuse > now - old->lastuse)
+        old = b;
+    }
+  }
+  return old;
 }
 
 // Look through buffer cache for block on device dev.
 // If not found, allocate a buffer.
 // In either case, return locked buffer.
+// For a prefetch, return 0 instead if the block is already
+// cached or no buffer is free.
 static struct buf*
-bget(uint dev, uint blockno)
+bget(uint dev, uint blockno, int prefetch)
 {
   struct buf *b;
+  struct bucket *bk, *vk;
+  int grown, waiting;
 
-  acquire(&bcache.lock);
+  bk = &bcache.bucket[BHASH(dev, blockno)];
+  acquire(&bk->lock);
 
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
+  if((b = bfind(bk, dev, blockno)) != 0){
+    if(prefetch)
+      b->refcnt--;
+    release(&bk->lock);
+    if(prefetch)
+      return 0;
+    percpu_inc(bhits);
+    acquiresleep(&b->lock);
+    return b;
+  }
+  release(&bk->lock);
+
+  // Not cached.  Rather than evict a cached block, grow the
+  // cache while memory is plentiful.
+  if(bcache.nbuf < NBUFMAX && kfreecount() > BCACHELOWAT)
+    bgrow(0);
+
+  // Take the recycling lock and look again, in case another
+  // process added the block meanwhile.
+  waiting = 0;
+  acquire(&bcache.lock);
+  for(;;){
+    acquire(&bk->lock);
+    if((b = bfind(bk, dev, blockno)) != 0){
+      if(prefetch)
+        b->refcnt--;
+      release(&bk->lock);
+      if(waiting)
+        bcache.nwait--;
       release(&bcache.lock);
+      if(prefetch)
+        return 0;
+      percpu_inc(bhits);
       acquiresleep(&b->lock);
       return b;
     }
-  }
+    release(&bk->lock);
+
+    // Recycle the least recently used unused buffer.  boldest()
+    // looks without bucket locks, so check again under one.
+    while((b = boldest()) != 0){
+      vk = &bcache.bucket[BHASH(b->dev, b->blockno)];
+      acquire(&vk->lock);
+      if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0){
+        bunhash(vk, b);
+        b->refcnt = 1;
+        release(&vk->lock);
 
-  // Not cached; recycle an unused buffer.
-  // Even if refcnt==0, B_DIRTY indicates a buffer is in use
-  // because log.c has modified it but not yet committed it.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->flags = 0;
-      b->refcnt = 1;
+        acquire(&bk->lock);
+        b->dev = dev;
+        b->blockno = blockno;
+        b->flags = 0;
+        b->hnext = bk->head;
+        bk->head = b;
+        release(&bk->lock);
+        if(waiting)
+          bcache.nwait--;
+        release(&bcache.lock);
+        percpu_inc(bmisses);
+        acquiresleep(&b->lock);
+        return b;
+      }
+      release(&vk->lock);
+    }
+    if(prefetch){
       release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+      return 0;
+    }
+
+    if(!waiting){
+      // Every buffer is in use or pinned by the log.  Grow
+      // the cache even below BCACHELOWAT rather than fail.
+      release(&bcache.lock);
+      grown = bgrow(0) == 0;
+      acquire(&bcache.lock);
+      if(grown)
+        continue;
+      // Nor can it grow: wait for bput() to free a buffer,
+      // as when the log commits.  Say so before looking
+      // again, so that a release after the look wakes us.
+      bcache.nwait++;
+      __sync_synchronize();
+      waiting = 1;
+      continue;
+    }
+    sleep(&bcache, &bcache.lock);
+  }
+}
+
+// Unhash every buffer in c, provided none is in use.
+// Returns 1 on success, leaving them with refcnt 1 so that
+// no one else can claim them, or 0 if one was busy.
+// Caller holds bcache.lock.
+static int
+bclaim(struct bchunk *c)
+{
+  struct bucket *bk;
+  struct buf *b;
+
+  for(b = c->buf; b < c->buf+NBPC; b++){
+    bk = &bcache.bucket[BHASH(b->dev, b->blockno)];
+    acquire(&bk->lock);
+    if(b->refcnt != 0 || (b->flags & B_DIRTY)){
+      release(&bk->lock);
+      // Give back the ones already claimed, as free buffers.
+      bk = &bcache.bucket[BHASH(0, 0)];
+      acquire(&bk->lock);
+      while(--b >= c->buf){
+        b->dev = 0;
+        b->blockno = 0;
+        b->flags = 0;
+        b->refcnt = 0;
+        b->hnext = bk->head;
+        bk->head = b;
+      }
+      release(&bk->lock);
+      return 0;
     }
+    bunhash(bk, b);
+    b->refcnt = 1;
+    release(&bk->lock);
+  }
+  return 1;
+}
+
+// Free a chunk of unused buffers, to relieve memory pressure.
+// Returns the number of pages freed.
+int
+bshrink(void)
+{
+  struct bchunk *c, **pc;
+  struct buf *b;
+  int i, busy;
+
+  acquire(&bcache.lock);
+  for(pc = &bcache.chunks; (c = *pc) != 0; pc = &c->next){
+    if(c->fixed)
+      continue;
+    // Skip chunks that are obviously in use before locking.
+    busy = 0;
+    for(b = c->buf; b < c->buf+NBPC; b++)
+      busy |= b->refcnt;
+    if(busy || !bclaim(c))
+      continue;
+
+    *pc = c->next;
+    bcache.nbuf -= NBPC;
+    release(&bcache.lock);
+    for(i = 0; i < NELEM(c->page); i++)
+      kfree(c->page[i]);
+    kfree((char*)c);
+    return NELEM(c->page) + 1;
+  }
+  release(&bcache.lock);
+  return 0;
+}
+
+// Report the cache size and hit counts, summed over cpus.
+void
+bcachestat(struct bcacheinfo *bi)
+{
+  struct cpu *c;
+
+  bi->nbuf = bcache.nbuf;
+  bi->maxbuf = NBUFMAX;
+  bi->hits = 0;
+  bi->misses = 0;
+  for(c = cpus; c < cpus+ncpu; c++){
+    bi->hits += *percpu_ptr(bhits, c);
+    bi->misses += *percpu_ptr(bmisses, c);
   }
-  panic("bget: no buffers");
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -98,13 +399,43 @@ bread(uint dev, uint blockno)
 {
   struct buf *b;
 
-  b = bget(dev, blockno);
+  b = bget(dev, blockno, 0);
   if((b->flags & B_VALID) == 0) {
     iderw(b);
   }
   return b;
 }
 
+// Return a locked buf for the indicated block without
+// reading it; the caller overwrites all of it.
+struct buf*
+bnew(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno, 0);
+  b->flags |= B_VALID;
+  return b;
+}
+
+// Start reading a block into the cache, unless it is there
+// already, without waiting for the disk.  The buffer stays
+// locked until the driver calls bdone().
+void
+bprefetch(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  if((b = bget(dev, blockno, 1)) == 0)
+    return;
+  // Someone may have looked it up and read it before we
+  // got the buffer lock.
+  if(b->flags & B_VALID)
+    brelse(b);
+  else
+    idereadahead(b);
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
@@ -115,8 +446,36 @@ bwrite(struct buf *b)
   iderw(b);
 }
 
+// Write the locked bufs bs[0..n-1] to disk in one batch,
+// which the disk driver may sort and merge.
+void
+bwritev(struct buf **bs, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++){
+    if(!holdingsleep(&bs[i]->lock))
+      panic("bwritev");
+    bs[i]->flags |= B_DIRTY;
+  }
+  idesubmit(bs, n);
+  for(i = 0; i < n; i++)
+    ideawait(bs[i]);
+}
+
+// Start writing b's contents to disk and return without
+// waiting.  Must be locked; the buffer is released when
+// the write is done, so the caller must not use it again.
+void
+bawrite(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bawrite");
+  b->flags |= B_DIRTY|B_ASYNC;
+  idesubmit(&b, 1);
+}
+
 // Release a locked buffer.
-// Move to the head of the MRU list.
 void
 brelse(struct buf *b)
 {
@@ -124,20 +483,43 @@ brelse(struct buf *b)
     panic("brelse");
 
   releasesleep(&b->lock);
+  bput(b);
+}
 
-  acquire(&bcache.lock);
+// Called by the disk driver, perhaps from its interrupt
+// handler, when the read started by bprefetch() completes.
+void
+bdone(struct buf *b)
+{
+  releasesleep(&b->lock);
+  bput(b);
+}
+
+// Drop a reference to an unlocked buffer.  Recycling and
+// bshrink() leave b alone while its refcnt is above 0, and
+// check it under the bucket lock, so that lock is enough.
+static void
+bput(struct buf *b)
+{
+  struct bucket *bk;
+  int last;
+
+  bk = &bcache.bucket[BHASH(b->dev, b->blockno)];
+  acquire(&bk->lock);
   b->refcnt--;
-  if (b->refcnt == 0) {
+  last = b->refcnt == 0;
+  if (last) {
     // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    b->lastuse = ticks;
+  }
+  release(&bk->lock);
+
+  // Wake any bget() that found no buffer to recycle.
+  if(last && bcache.nwait){
+    acquire(&bcache.lock);
+    wakeup(&bcache);
+    release(&bcache.lock);
   }
-  
-  release(&bcache.lock);
 }
 //PAGEBREAK!
 // Blank page.
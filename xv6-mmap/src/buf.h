@@ -4,11 +4,14 @@ struct buf {
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
-  struct buf *next;
+  uint lastuse;     // ticks at last release, for LRU recycling
+  struct buf *hnext; // hash chain
   struct buf *qnext; // disk queue
-  uchar data[BSIZE];
+  uint qtime;       // ticks when queued for the disk
+  uchar *data;      // BSIZE bytes, in a page owned by bio.c
 };
 #define B_VALID 0x2  // buffer has been read from disk
 #define B_DIRTY 0x4  // buffer needs to be written to disk
+#define B_ASYNC 0x8  // no one waits for the I/O; bdone() it when done
+#define B_ERR   0x10 // the disk failed the I/O
 
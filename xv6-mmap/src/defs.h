@@ -1,9 +1,15 @@
+struct bcacheinfo;
 struct buf;
 struct context;
 struct file;
 struct inode;
+struct lockclass;
+struct lockinfo;
 struct pipe;
+struct rastate;
 struct proc;
+struct procinfo;
+struct cpuinfo;
 struct rtcdate;
 struct spinlock;
 struct sleeplock;
@@ -13,8 +19,15 @@ struct superblock;
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
+struct buf*     bnew(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bwritev(struct buf**, int);
+void            bawrite(struct buf*);
+void            bprefetch(uint, uint);
+void            bdone(struct buf*);
+int             bshrink(void);
+void            bcachestat(struct bcacheinfo*);
 
 // console.c
 void            consoleinit(void);
@@ -37,11 +50,14 @@ int             filewrite(struct file*, char*, int n);
 // fs.c
 void            readsb(int dev, struct superblock *sb);
 int             dirlink(struct inode*, char*, uint);
+void            dcacheinval(struct inode*, char*);
+void            dcachepurge(struct inode*);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
 void            iinit(int dev);
 void            ilock(struct inode*);
+void            ilockshared(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
@@ -50,13 +66,26 @@ int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, char*, uint, uint);
+void            readahead(struct inode*, struct rastate*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
+void            mount(char*, uint);
+int             ismountpoint(struct inode*);
 
 // ide.c
 void            ideinit(void);
 void            ideintr(void);
 void            iderw(struct buf*);
+void            idesubmit(struct buf**, int);
+void            ideawait(struct buf*);
+void            idereadahead(struct buf*);
+
+// virtio.c
+int             virtioinit(void);
+extern int      virtioirq;
+void            virtiointr(void);
+void            virtiosubmit(struct buf**, int);
+void            virtioawait(struct buf*);
 
 // ioapic.c
 void            ioapicenable(int irq, int cpu);
@@ -68,8 +97,10 @@ char*           kalloc(void);
 void            kfree(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
+int             kfreecount(void);
 
 // kmalloc.c
+void            kminit(void);
 void*           kmalloc(uint nbytes);
 void            kmfree(void *addr);
 void*           mmap(void *addr, int length, int prot, int flags, int fd, int offset);
@@ -90,13 +121,27 @@ void            microdelay(int);
 // log.c
 void            initlog(int dev);
 void            log_write(struct buf*);
+void            log_data(struct buf*);
+void            log_free(uint);
+int             log_busy(uint);
 void            begin_op();
+void            begin_opn(int, int);
 void            end_op();
+void            end_opn(int, int);
+int             log_datamax(int);
+void            log_sync(void);
 
 // mp.c
 extern int      ismp;
 void            mpinit(void);
 
+// pci.c
+uint            pciconfread(int, int);
+void            pciconfwrite(int, int, uint);
+int             pcifind(int, int);
+int             pcifindclass(int, int);
+uint            pciiobar(int, int);
+
 // picirq.c
 void            picenable(int);
 void            picinit(void);
@@ -109,19 +154,34 @@ int             pipewrite(struct pipe*, char*, int);
 
 //PAGEBREAK: 16
 // proc.c
+int             clone(void(*)(void*, void*), void*, void*, void*);
 int             cpuid(void);
+int             detachuvm(struct proc*);
 void            exit(void);
 int             fork(void);
+int             getaffinity(int);
+int             getcpuinfo(struct cpuinfo*, int);
+int             getprocinfo(struct procinfo*, int);
+int             futex_wait(uint*, uint);
+int             futex_wake(uint*, int);
 int             growproc(int);
+int             growproc1(int);
+int             join(void**);
 int             kill(int);
+int             kthread(void (*)(void), char*);
+void            lockvm(struct proc*);
 struct cpu*     mycpu(void);
+struct cpu*     lapiccpu(void);
 struct proc*    myproc();
 void            pinit(void);
 void            procdump(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
+int             setaffinity(int, uint);
 void            setproc(struct proc*);
+void            shareuvm(struct proc*);
 void            sleep(void*, struct spinlock*);
+void            unlockvm(struct proc*);
 void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
@@ -139,9 +199,19 @@ void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
 
+// lockprof.c
+#ifdef LOCKSTAT
+struct lockclass* lockclass(char*, int);
+void            lockacquired(struct lockclass*, struct cpu*, int, uint64);
+void            lockreleased(struct lockclass*, struct cpu*, uint64);
+#endif
+int             lockstat(struct lockinfo*, int, int);
+
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
+void            acquiresleepshared(struct sleeplock*);
+void            releasesleepshared(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
@@ -171,6 +241,15 @@ extern uint     ticks;
 void            tvinit(void);
 extern struct spinlock tickslock;
 
+// tmpfs.c
+void            tmpinit(void);
+uint            tmpialloc(short);
+void            tmpiload(struct inode*);
+void            tmpiupdate(struct inode*);
+void            tmpitrunc(struct inode*);
+int             tmpreadi(struct inode*, char*, uint, uint);
+int             tmpwritei(struct inode*, char*, uint, uint);
+
 // uart.c
 void            uartinit(void);
 void            uartintr(void);
@@ -178,6 +257,7 @@ void            uartputc(int);
 
 // vm.c
 void            seginit(void);
+void            percpuinit(void);
 void            kvmalloc(void);
 pde_t*          setupkvm(void);
 char*           uva2ka(pde_t*, char*);
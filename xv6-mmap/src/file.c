@@ -10,6 +10,8 @@
 #include "sleeplock.h"
 #include "file.h"
 
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
 struct devsw devsw[NDEV];
 struct {
   struct spinlock lock;
@@ -84,7 +86,7 @@ int
 filestat(struct file *f, struct stat *st)
 {
   if(f->type == FD_INODE){
-    ilock(f->ip);
+    ilockshared(f->ip);
     stati(f->ip, st);
     iunlock(f->ip);
     return 0;
@@ -96,14 +98,25 @@ filestat(struct file *f, struct stat *st)
 int
 fileread(struct file *f, char *addr, int n)
 {
-  int r;
+  int r, shared;
 
   if(f->readable == 0)
     return -1;
   if(f->type == FD_PIPE)
     return piperead(f->pipe, addr, n);
   if(f->type == FD_INODE){
-    ilock(f->ip);
+    // f->off and f->ra are updated under the inode lock, so
+    // readers may only share it if no one else can use this
+    // struct file.  A filedup() after the check takes the
+    // exclusive lock for its reads, which waits for ours.
+    acquire(&ftable.lock);
+    shared = f->ref == 1;
+    release(&ftable.lock);
+    if(shared)
+      ilockshared(f->ip);
+    else
+      ilock(f->ip);
+    readahead(f->ip, &f->ra, f->off, n);
     if((r = readi(f->ip, addr, f->off, n)) > 0)
       f->off += r;
     iunlock(f->ip);
@@ -124,25 +137,33 @@ filewrite(struct file *f, char *addr, int n)
   if(f->type == FD_PIPE)
     return pipewrite(f->pipe, addr, n);
   if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
+    // write up to NINDIRECT blocks at a time, as many as
+    // one log transaction takes, reserving space for the
+    // data blocks with 2 blocks of slop for non-aligned
+    // writes, and in the log for their allocation blocks,
+    // the indirect blocks that list them and the i-node:
+    // at most 8 blocks.  tmpfs logs nothing, and need not
+    // wait for commits.
     // this really belongs lower down, since writei()
     // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
+    int tmp = f->ip->dev == TMPDEV;
+    int max = (min(log_datamax(8), NINDIRECT) - 2) * BSIZE;
     int i = 0;
     while(i < n){
       int n1 = n - i;
       if(n1 > max)
         n1 = max;
+      int nd = n1/BSIZE + 2;
+      int nlog = nd/BPB + 2 + nd/NINDIRECT + 3 + 1;
 
-      begin_op();
+      if(!tmp)
+        begin_opn(nlog, nd);
       ilock(f->ip);
       if ((r = writei(f->ip, addr + i, f->off, n1)) > 0)
         f->off += r;
       iunlock(f->ip);
-      end_op();
+      if(!tmp)
+        end_opn(nlog, nd);
 
       if(r < 0)
         break;
@@ -1,3 +1,10 @@
+// Sequential read-ahead state, see readahead() in fs.c.
+struct rastate {
+  uint next;          // Block a sequential reader reads next
+  uint win;           // Blocks to read ahead of it; 0 if not sequential
+  uint ahead;         // First block not yet prefetched
+};
+
 struct file {
   enum { FD_NONE, FD_PIPE, FD_INODE } type;
   int ref; // reference count
@@ -6,6 +13,7 @@ struct file {
   struct pipe *pipe;
   struct inode *ip;
   uint off;
+  struct rastate ra;
 };
 
 
@@ -22,7 +30,7 @@ struct inode {
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  uint addrs[NDIRECT+2];
 };
 
 // table mapping major device number to
@@ -44,7 +44,7 @@ bzero(int dev, int bno)
 {
   struct buf *bp;
 
-  bp = bread(dev, bno);
+  bp = bnew(dev, bno);
   memset(bp->data, 0, BSIZE);
   log_write(bp);
   brelse(bp);
@@ -52,7 +52,8 @@ bzero(int dev, int bno)
 
 // Blocks.
 
-// Allocate a zeroed disk block.
+// Allocate a disk block.  The caller must zero it, or
+// overwrite all of it.
 static uint
 balloc(uint dev)
 {
@@ -64,11 +65,11 @@ balloc(uint dev)
     bp = bread(dev, BBLOCK(b, sb));
     for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
       m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
+      // Is block free, and not still in use by the log?
+      if((bp->data[bi/8] & m) == 0 && !log_busy(b + bi)){
         bp->data[bi/8] |= m;  // Mark block in use.
         log_write(bp);
         brelse(bp);
-        bzero(dev, b + bi);
         return b + bi;
       }
     }
@@ -93,6 +94,7 @@ bfree(int dev, uint b)
   bp->data[bi/8] &= ~m;
   log_write(bp);
   brelse(bp);
+  log_free(b);
 }
 
 // Inodes.
@@ -135,7 +137,9 @@ bfree(int dev, uint b)
 //
 // * Locked: file system code may only examine and modify
 //   the information in an inode and its content if it
-//   has first locked the inode.
+//   has first locked the inode.  Code that only examines
+//   them may use ilockshared() instead of ilock(), so that
+//   readers of the same inode do not wait for each other.
 //
 // Thus a typical sequence is:
 //   ip = iget(dev, inum)
@@ -169,21 +173,42 @@ struct {
   struct inode inode[NINODE];
 } icache;
 
+// Directory entry cache; see dcachelookup() below.
+#define NDHASH 64
+
+struct dentry {
+  uint dev;
+  uint parent;          // Inode number of the directory
+  char name[DIRSIZ];
+  uint inum;            // Inode number of name, or 0 if absent
+  struct dentry *next;  // Hash chain; 0-dev entries are unused
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry dentry[NDENTRY];
+  struct dentry *hash[NDHASH];
+  int hand;             // Next entry to replace
+} dcache;
+
 void
 iinit(int dev)
 {
   int i = 0;
   
   initlock(&icache.lock, "icache");
+  initlock(&dcache.lock, "dcache");
   for(i = 0; i < NINODE; i++) {
     initsleeplock(&icache.inode[i].lock, "inode");
   }
 
   readsb(dev, &sb);
   cprintf("sb: size %d nblocks %d ninodes %d nlog %d logstart %d\
- inodestart %d bmap start %d\n", sb.size, sb.nblocks,
+ inodestart %d bmap start %d bsize %d\n", sb.size, sb.nblocks,
           sb.ninodes, sb.nlog, sb.logstart, sb.inodestart,
-          sb.bmapstart);
+          sb.bmapstart, sb.bsize);
+  if(sb.bsize != BSIZE)
+    panic("iinit: file system block size");
 }
 
 static struct inode* iget(uint dev, uint inum);
@@ -199,6 +224,9 @@ ialloc(uint dev, short type)
   struct buf *bp;
   struct dinode *dip;
 
+  if(dev == TMPDEV)
+    return iget(dev, tmpialloc(type));
+
   for(inum = 1; inum < sb.ninodes; inum++){
     bp = bread(dev, IBLOCK(inum, sb));
     dip = (struct dinode*)bp->data + inum%IPB;
@@ -224,6 +252,11 @@ iupdate(struct inode *ip)
   struct buf *bp;
   struct dinode *dip;
 
+  if(ip->dev == TMPDEV){
+    tmpiupdate(ip);
+    return;
+  }
+
   bp = bread(ip->dev, IBLOCK(ip->inum, sb));
   dip = (struct dinode*)bp->data + ip->inum%IPB;
   dip->type = ip->type;
@@ -297,29 +330,62 @@ ilock(struct inode *ip)
   acquiresleep(&ip->lock);
 
   if(ip->valid == 0){
-    bp = bread(ip->dev, IBLOCK(ip->inum, sb));
-    dip = (struct dinode*)bp->data + ip->inum%IPB;
-    ip->type = dip->type;
-    ip->major = dip->major;
-    ip->minor = dip->minor;
-    ip->nlink = dip->nlink;
-    ip->size = dip->size;
-    memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
-    brelse(bp);
+    if(ip->dev == TMPDEV)
+      tmpiload(ip);
+    else {
+      bp = bread(ip->dev, IBLOCK(ip->inum, sb));
+      dip = (struct dinode*)bp->data + ip->inum%IPB;
+      ip->type = dip->type;
+      ip->major = dip->major;
+      ip->minor = dip->minor;
+      ip->nlink = dip->nlink;
+      ip->size = dip->size;
+      memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
+      brelse(bp);
+    }
     ip->valid = 1;
     if(ip->type == 0)
       panic("ilock: no type");
   }
 }
 
-// Unlock the given inode.
+// Lock the given inode for reading only.
+// Other readers may hold it at the same time, so the caller
+// must not modify the inode or its content.
+void
+ilockshared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("ilockshared");
+
+  acquiresleepshared(&ip->lock);
+  if(ip->valid == 0){
+    // Reading the inode in from disk writes to it; do that
+    // under the exclusive lock.  It stays valid while we
+    // hold our reference.
+    releasesleepshared(&ip->lock);
+    ilock(ip);
+    iunlock(ip);
+    acquiresleepshared(&ip->lock);
+  }
+}
+
+// Unlock the given inode, whether it was locked by ilock()
+// or ilockshared().  Shared holders are not recorded per
+// lock, but a process that holds no lock shared cannot be
+// one of ip's readers.
 void
 iunlock(struct inode *ip)
 {
-  if(ip == 0 || !holdingsleep(&ip->lock) || ip->ref < 1)
+  if(ip == 0 || ip->ref < 1)
     panic("iunlock");
 
-  releasesleep(&ip->lock);
+  if(holdingsleep(&ip->lock))
+    releasesleep(&ip->lock);
+  else if(myproc()->nshared > 0 && ip->lock.readers > 0)
+    releasesleepshared(&ip->lock);
+  else
+    panic("iunlock");
 }
 
 // Drop a reference to an in-memory inode.
@@ -366,19 +432,47 @@ iunlockput(struct inode *ip)
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in block ip->addrs[NDIRECT].  Block ip->addrs[NDIRECT+1]
+// lists NINDIRECT more indirect blocks, for the NDINDIRECT
+// blocks after that, so mapping a block takes at most two reads.
+
+// Allocate a zeroed disk block.
+static uint
+bzalloc(uint dev)
+{
+  uint b;
+
+  b = balloc(dev);
+  bzero(dev, b);
+  return b;
+}
+
+// Allocate a data block for bmap().  It is zeroed, unless
+// fresh is not 0: then *fresh is set, and the caller must
+// fill the block in.
+static uint
+dalloc(uint dev, int *fresh)
+{
+  if(fresh == 0)
+    return bzalloc(dev);
+  *fresh = 1;
+  return balloc(dev);
+}
 
 // Return the disk block address of the nth block in inode ip.
-// If there is no such block, bmap allocates one.
+// If there is no such block, bmap allocates one.  If fresh
+// is not 0, *fresh says whether it did so without zeroing.
 static uint
-bmap(struct inode *ip, uint bn)
+bmap(struct inode *ip, uint bn, int *fresh)
 {
   uint addr, *a;
   struct buf *bp;
 
+  if(fresh)
+    *fresh = 0;
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+      ip->addrs[bn] = addr = dalloc(ip->dev, fresh);
     return addr;
   }
   bn -= NDIRECT;
@@ -386,11 +480,34 @@ bmap(struct inode *ip, uint bn)
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
     if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
+      ip->addrs[NDIRECT] = addr = bzalloc(ip->dev);
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
     if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
+      a[bn] = addr = dalloc(ip->dev, fresh);
+      log_write(bp);
+    }
+    brelse(bp);
+    return addr;
+  }
+  bn -= NINDIRECT;
+
+  if(bn < NDINDIRECT){
+    // Load double-indirect block, then the indirect block
+    // it lists, allocating if necessary.
+    if((addr = ip->addrs[NDIRECT+1]) == 0)
+      ip->addrs[NDIRECT+1] = addr = bzalloc(ip->dev);
+    bp = bread(ip->dev, addr);
+    a = (uint*)bp->data;
+    if((addr = a[bn / NINDIRECT]) == 0){
+      a[bn / NINDIRECT] = addr = bzalloc(ip->dev);
+      log_write(bp);
+    }
+    brelse(bp);
+    bp = bread(ip->dev, addr);
+    a = (uint*)bp->data;
+    if((addr = a[bn % NINDIRECT]) == 0){
+      a[bn % NINDIRECT] = addr = dalloc(ip->dev, fresh);
       log_write(bp);
     }
     brelse(bp);
@@ -408,9 +525,16 @@ bmap(struct inode *ip, uint bn)
 static void
 itrunc(struct inode *ip)
 {
-  int i, j;
-  struct buf *bp;
-  uint *a;
+  int i, j, k;
+  struct buf *bp, *bp2;
+  uint *a, *a2;
+
+  if(ip->dev == TMPDEV){
+    tmpitrunc(ip);
+    ip->size = 0;
+    iupdate(ip);
+    return;
+  }
 
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
@@ -431,6 +555,26 @@ itrunc(struct inode *ip)
     ip->addrs[NDIRECT] = 0;
   }
 
+  if(ip->addrs[NDIRECT+1]){
+    bp = bread(ip->dev, ip->addrs[NDIRECT+1]);
+    a = (uint*)bp->data;
+    for(j = 0; j < NINDIRECT; j++){
+      if(a[j] == 0)
+        continue;
+      bp2 = bread(ip->dev, a[j]);
+      a2 = (uint*)bp2->data;
+      for(k = 0; k < NINDIRECT; k++){
+        if(a2[k])
+          bfree(ip->dev, a2[k]);
+      }
+      brelse(bp2);
+      bfree(ip->dev, a[j]);
+    }
+    brelse(bp);
+    bfree(ip->dev, ip->addrs[NDIRECT+1]);
+    ip->addrs[NDIRECT+1] = 0;
+  }
+
   ip->size = 0;
   iupdate(ip);
 }
@@ -466,9 +610,11 @@ readi(struct inode *ip, char *dst, uint off, uint n)
     return -1;
   if(off + n > ip->size)
     n = ip->size - off;
+  if(ip->dev == TMPDEV)
+    return tmpreadi(ip, dst, off, n);
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    bp = bread(ip->dev, bmap(ip, off/BSIZE, 0));
     m = min(n - tot, BSIZE - off%BSIZE);
     memmove(dst, bp->data + off%BSIZE, m);
     brelse(bp);
@@ -476,13 +622,51 @@ readi(struct inode *ip, char *dst, uint off, uint n)
   return n;
 }
 
+// Called before reading n > 0 bytes at off from ip, so that
+// sequential readers find the blocks they want next already
+// in the cache or on their way.  Reads that continue where
+// the last one left off double the read-ahead window, from
+// RAMIN up to RAMAX blocks; any other read closes it.
+// Caller must hold ip->lock.
+void
+readahead(struct inode *ip, struct rastate *ra, uint off, uint n)
+{
+  uint first, last, end, bn;
+
+  if(ip->type == T_DEV || ip->dev == TMPDEV || n == 0 || off >= ip->size)
+    return;
+  first = off / BSIZE;
+  last = (off + n - 1) / BSIZE;
+
+  if(first == ra->next)
+    ra->win = ra->win ? min(2*ra->win, RAMAX) : RAMIN;
+  else if(first + 1 != ra->next){
+    // Not continuing in the last block read either.
+    ra->win = 0;
+    ra->ahead = 0;
+  }
+  ra->next = last + 1;
+  if(ra->win == 0)
+    return;
+
+  // Only prefetch blocks inside the file, which bmap()
+  // will not try to allocate.
+  end = min(last + 1 + ra->win, (ip->size + BSIZE - 1) / BSIZE);
+  bn = ra->ahead > last + 1 ? ra->ahead : last + 1;
+  for(; bn < end; bn++)
+    bprefetch(ip->dev, bmap(ip, bn, 0));
+  if(end > ra->ahead)
+    ra->ahead = end;
+}
+
 // PAGEBREAK!
 // Write data to inode.
 // Caller must hold ip->lock.
 int
 writei(struct inode *ip, char *src, uint off, uint n)
 {
-  uint tot, m;
+  uint tot, m, addr;
+  int fresh;
   struct buf *bp;
 
   if(ip->type == T_DEV){
@@ -493,15 +677,32 @@ writei(struct inode *ip, char *src, uint off, uint n)
 
   if(off > ip->size || off + n < off)
     return -1;
-  if(off + n > MAXFILE*BSIZE)
-    return -1;
 
-  for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
-    m = min(n - tot, BSIZE - off%BSIZE);
-    memmove(bp->data + off%BSIZE, src, m);
-    log_write(bp);
-    brelse(bp);
+  if(ip->dev == TMPDEV){
+    if(tmpwritei(ip, src, off, n) < 0)
+      return -1;
+    off += n;
+  } else {
+    if((off + n)/BSIZE > MAXFILE)
+      return -1;
+    for(tot=0; tot<n; tot+=m, off+=m, src+=m){
+      addr = bmap(ip, off/BSIZE, &fresh);
+      m = min(n - tot, BSIZE - off%BSIZE);
+      // Don't read a block that is about to be overwritten,
+      // nor zero a new one first on disk.
+      if(fresh || m == BSIZE)
+        bp = bnew(ip->dev, addr);
+      else
+        bp = bread(ip->dev, addr);
+      if(fresh && m < BSIZE)
+        memset(bp->data, 0, BSIZE);
+      memmove(bp->data + off%BSIZE, src, m);
+      if(ip->type == T_FILE)
+        log_data(bp);
+      else
+        log_write(bp);
+      brelse(bp);
+    }
   }
 
   if(n > 0 && off > ip->size){
@@ -574,10 +775,136 @@ dirlink(struct inode *dp, char *name, uint inum)
   de.inum = inum;
   if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
     panic("dirlink");
+  dcacheinval(dp, name);
 
   return 0;
 }
 
+//PAGEBREAK!
+// Directory entry cache.
+//
+// The dcache remembers the result of dirlookup() for
+// (directory, name) pairs, so that namex() can step through
+// a cached path component without locking or reading the
+// directory.  Entries are keyed by device and inode number,
+// since icache entries are recycled, and map to the inode
+// number found, or to 0 if the name was not there (a
+// negative entry).
+//
+// Entries are added by namex() while it holds the directory
+// locked, and removed by dirlink() and sys_unlink() while
+// they hold it locked exclusively, so an entry never goes
+// stale.  Removing a directory drops every entry under it,
+// since its inode number may be reused.  The dcache.lock
+// spin-lock protects the table, and is taken before
+// icache.lock; full, it replaces entries round-robin.  The
+// entries themselves are declared with the inode cache above.
+
+static struct dentry**
+dhash(uint dev, uint parent, char *name)
+{
+  uint h;
+  int i;
+
+  h = dev * 31 + parent;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 31 + name[i];
+  return &dcache.hash[h % NDHASH];
+}
+
+// Find the entry for name in dp.  Caller holds dcache.lock.
+static struct dentry*
+dfind(struct inode *dp, char *name)
+{
+  struct dentry *d;
+
+  for(d = *dhash(dp->dev, dp->inum, name); d; d = d->next)
+    if(d->dev == dp->dev && d->parent == dp->inum &&
+       namecmp(d->name, name) == 0)
+      return d;
+  return 0;
+}
+
+// Unlink d from its hash chain.  Caller holds dcache.lock.
+static void
+dunhash(struct dentry *d)
+{
+  struct dentry **pp;
+
+  for(pp = dhash(d->dev, d->parent, d->name); *pp; pp = &(*pp)->next)
+    if(*pp == d){
+      *pp = d->next;
+      break;
+    }
+  d->dev = 0;
+}
+
+// Look up name in the directory dp, which need not be locked.
+// Returns 1 on a hit and sets *ipp to a reference to the inode
+// (0 for a known-absent name).  The reference is taken before
+// dcache.lock is released, so a racing unlink cannot free the
+// inode first: dcacheinval() precedes its final iput().
+static int
+dcachelookup(struct inode *dp, char *name, struct inode **ipp)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  if((d = dfind(dp, name)) != 0)
+    *ipp = d->inum ? iget(dp->dev, d->inum) : 0;
+  release(&dcache.lock);
+  return d != 0;
+}
+
+// Remember that name in dp is inum (0 if absent).
+// Caller holds dp locked.
+static void
+dcacheenter(struct inode *dp, char *name, uint inum)
+{
+  struct dentry *d, **h;
+
+  acquire(&dcache.lock);
+  if((d = dfind(dp, name)) == 0){
+    d = &dcache.dentry[dcache.hand];
+    dcache.hand = (dcache.hand + 1) % NDENTRY;
+    if(d->dev)
+      dunhash(d);
+    d->dev = dp->dev;
+    d->parent = dp->inum;
+    strncpy(d->name, name, DIRSIZ);
+    h = dhash(d->dev, d->parent, d->name);
+    d->next = *h;
+    *h = d;
+  }
+  d->inum = inum;
+  release(&dcache.lock);
+}
+
+// Forget name in dp.  Caller holds dp locked exclusively.
+void
+dcacheinval(struct inode *dp, char *name)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  if((d = dfind(dp, name)) != 0)
+    dunhash(d);
+  release(&dcache.lock);
+}
+
+// Forget every name in the directory dp, which is being removed.
+void
+dcachepurge(struct inode *dp)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  for(d = dcache.dentry; d < &dcache.dentry[NDENTRY]; d++)
+    if(d->dev == dp->dev && d->parent == dp->inum)
+      dunhash(d);
+  release(&dcache.lock);
+}
+
 //PAGEBREAK!
 // Paths
 
@@ -618,6 +945,87 @@ skipelem(char *path, char *name)
   return path;
 }
 
+// Mount points.  Each entry holds references to a directory
+// and to the root of the file system mounted on it, so both
+// stay in the icache and can be compared by pointer.  Mounts
+// happen only at boot, so lookups read the table unlocked.
+static struct {
+  struct inode *on;
+  struct inode *root;
+} mounts[NMOUNT];
+
+// Mount the file system on dev, which must already have a
+// root directory, on the directory path.
+void
+mount(char *path, uint dev)
+{
+  int i;
+  struct inode *dp;
+
+  begin_op();
+  if((dp = namei(path)) == 0)
+    panic("mount: no mount point");
+  ilock(dp);
+  if(dp->type != T_DIR)
+    panic("mount: not a directory");
+  iunlock(dp);
+  end_op();
+  for(i = 0; i < NMOUNT; i++){
+    if(mounts[i].on == 0){
+      mounts[i].root = iget(dev, ROOTINO);
+      mounts[i].on = dp;
+      return;
+    }
+  }
+  panic("mount: too many");
+}
+
+// Is ip a directory something is mounted on?
+int
+ismountpoint(struct inode *ip)
+{
+  int i;
+
+  for(i = 0; i < NMOUNT; i++)
+    if(mounts[i].on == ip)
+      return 1;
+  return 0;
+}
+
+// If ip is a mount point, put it and return the root
+// mounted there instead.
+static struct inode*
+mountin(struct inode *ip)
+{
+  int i;
+
+  for(i = 0; i < NMOUNT; i++){
+    if(mounts[i].on == ip){
+      iput(ip);
+      return idup(mounts[i].root);
+    }
+  }
+  return ip;
+}
+
+// ".." from the root of a mounted file system leads out of
+// it: put ip and return the mount point to look ".." up in.
+static struct inode*
+mountout(struct inode *ip, char *name)
+{
+  int i;
+
+  if(namecmp(name, "..") != 0)
+    return ip;
+  for(i = 0; i < NMOUNT; i++){
+    if(mounts[i].root == ip){
+      iput(ip);
+      return idup(mounts[i].on);
+    }
+  }
+  return ip;
+}
+
 // Look up and return the inode for a path name.
 // If parent != 0, return the inode for the parent and copy the final
 // path element into name, which must have room for DIRSIZ bytes.
@@ -633,7 +1041,19 @@ namex(char *path, int nameiparent, char *name)
     ip = idup(myproc()->cwd);
 
   while((path = skipelem(path, name)) != 0){
-    ilock(ip);
+    ip = mountout(ip, name);
+    if(!(nameiparent && *path == '\0') && dcachelookup(ip, name, &next)){
+      // Cached: only directories have entries, so no need
+      // to lock ip to check its type or read it.
+      if(next == 0){
+        iput(ip);
+        return 0;
+      }
+      iput(ip);
+      ip = mountin(next);
+      continue;
+    }
+    ilockshared(ip);
     if(ip->type != T_DIR){
       iunlockput(ip);
       return 0;
@@ -644,11 +1064,13 @@ namex(char *path, int nameiparent, char *name)
       return ip;
     }
     if((next = dirlookup(ip, name, 0)) == 0){
+      dcacheenter(ip, name, 0);
       iunlockput(ip);
       return 0;
     }
+    dcacheenter(ip, name, next->inum);
     iunlockput(ip);
-    ip = next;
+    ip = mountin(next);
   }
   if(nameiparent){
     iput(ip);
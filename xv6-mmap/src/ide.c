@@ -1,4 +1,8 @@
-// Simple PIO-based (non-DMA) IDE driver code.
+// Simple IDE driver code, which also routes disk 1 to
+// virtio.c when there is a virtio-blk disk.
+// Requests are queued in sector order and adjacent ones
+// merged into multi-sector commands.  Data moves by bus-master
+// DMA when the PCI IDE controller offers it, else by PIO.
 
 #include "types.h"
 #include "defs.h"
@@ -17,22 +21,69 @@
 #define IDE_BSY       0x80
 #define IDE_DRDY      0x40
 #define IDE_DF        0x20
+#define IDE_DRQ       0x08
 #define IDE_ERR       0x01
 
 #define IDE_CMD_READ  0x20
 #define IDE_CMD_WRITE 0x30
 #define IDE_CMD_RDMUL 0xc4
 #define IDE_CMD_WRMUL 0xc5
+#define IDE_CMD_SETMUL 0xc6
+#define IDE_CMD_RDDMA 0xc8
+#define IDE_CMD_WRDMA 0xca
 
-// idequeue points to the buf now being read/written to the disk.
-// idequeue->qnext points to the next buf to be processed.
-// You must hold idelock while manipulating queue.
+// Bus-master DMA registers of the primary channel,
+// relative to the controller's BAR4.
+#define BM_CMD        0    // command
+#define BM_STATUS     2    // status
+#define BM_PRDT       4    // physical address of PRD table
+
+#define BM_START      0x01 // command: start transfer
+#define BM_READ       0x08 // command: device to memory
+#define BM_ERR        0x02 // status: error; write 1 to clear
+#define BM_INTR       0x04 // status: interrupt; write 1 to clear
+
+// Physical region descriptor: one piece of a DMA transfer.
+// A piece may not cross a 64 KB boundary.
+struct prd {
+  uint addr;
+  ushort len;
+  ushort flags;
+};
+#define PRD_EOT       0x8000 // last descriptor
+
+#define IDEMULT       16   // sectors per interrupt asked of the drive
+#define IDEMAXSECT   128   // most sectors merged into one command
+
+// Does virtio.c serve b's disk?
+#define ONVIRTIO(b)  (havevirtio && (b)->dev == 1)
+
+// Sort key of a request: disk and block number.
+#define IDEKEY(b)  (((b)->dev << 28) | (b)->blockno)
+
+// idequeue holds the pending bufs, sorted by IDEKEY, linked
+// through qnext.  ideactive is the list of contiguous bufs
+// that the command now running on the disk transfers.
+// You must hold idelock while manipulating either list.
 
 static struct spinlock idelock;
 static struct buf *idequeue;
+static struct buf *ideactive;
+
+// State of the active command.
+static int idewrite;     // writing ideactive, not reading it
+static uint idensect;    // sectors it transfers
+static uint idedone;     // sectors transferred so far
+static struct buf *idecur; // buf holding sector idedone
+static uint idepos;      // IDEKEY just past it; the elevator's head
+static int ideerr;       // the drive reported an error
 
 static int havedisk1;
-static void idestart(struct buf*);
+static int havevirtio;   // disk 1 is virtio-blk, not IDE
+static int idemult[2];   // sectors per interrupt, per drive
+static uint idebm;       // bus-master registers; 0 means PIO
+static struct prd *ideprd; // PRD table, in its own page
+static int idestart(void);
 
 // Wait for IDE disk to become ready.
 static int
@@ -47,6 +98,22 @@ idewait(int checkerr)
   return 0;
 }
 
+// Ask drive dev to transfer IDEMULT sectors per interrupt
+// in RDMUL/WRMUL commands.  Returns the number it will use;
+// 1 means fall back to plain READ/WRITE.
+static int
+idesetmult(int dev)
+{
+  idewait(0);
+  outb(0x3f6, 2);  // no interrupt
+  outb(0x1f6, 0xe0 | ((dev&1)<<4));
+  outb(0x1f2, IDEMULT);
+  outb(0x1f7, IDE_CMD_SETMUL);
+  if(idewait(1) < 0)
+    return 1;
+  return IDEMULT;
+}
+
 void
 ideinit(void)
 {
@@ -65,37 +132,213 @@ ideinit(void)
     }
   }
 
+  // A virtio-blk disk, if QEMU has one, stands in for disk 1.
+  if(virtioinit() == 0){
+    havevirtio = 1;
+    havedisk1 = 0;
+  }
+
+  idemult[0] = idesetmult(0);
+  if(havedisk1)
+    idemult[1] = idesetmult(1);
+
+  // Use DMA if there is a PCI IDE controller with
+  // bus-master registers.
+  if((i = pcifindclass(0x01, 0x01)) >= 0 && (idebm = pciiobar(i, 4)) != 0){
+    if((ideprd = (struct prd*)kalloc()) == 0)
+      idebm = 0;
+    else  // enable I/O space and bus mastering
+      pciconfwrite(i, 0x04, pciconfread(i, 0x04) | 0x5);
+  }
+
   // Switch back to disk 0.
   outb(0x1f6, 0xe0 | (0<<4));
 }
 
-// Start the request for b.  Caller must hold idelock.
+// Pick the next request to start.  Normally the elevator
+// sweeps upward: the first request at or past the head,
+// wrapping to the lowest.  A request queued for IDEDEADLINE
+// ticks goes first, so a busy region cannot starve others.
+// Caller must hold idelock.
+static struct buf**
+idepick(void)
+{
+  struct buf **pp, **old, **next;
+
+  old = next = 0;
+  for(pp=&idequeue; *pp; pp=&(*pp)->qnext){
+    if(old == 0 || (int)((*pp)->qtime - (*old)->qtime) < 0)
+      old = pp;
+    if(next == 0 && IDEKEY(*pp) >= idepos)
+      next = pp;
+  }
+  if(old && ticks - (*old)->qtime >= IDEDEADLINE)
+    return old;
+  if(next)
+    return next;
+  return &idequeue;
+}
+
+// Move the next interrupt's worth of sectors of the active
+// command between the disk and its bufs.
+static void
+idexfer(void)
+{
+  uint n, off;
+
+  n = idemult[ideactive->dev&1];
+  if(n > idensect - idedone)
+    n = idensect - idedone;
+  for(; n > 0; n--){
+    off = (idedone % (BSIZE/SECTOR_SIZE)) * SECTOR_SIZE;
+    if(idewrite)
+      outsl(0x1f0, idecur->data + off, SECTOR_SIZE/4);
+    else
+      insl(0x1f0, idecur->data + off, SECTOR_SIZE/4);
+    idedone++;
+    if(idedone % (BSIZE/SECTOR_SIZE) == 0)
+      idecur = idecur->qnext;
+  }
+}
+
+// Fill the PRD table with the bufs of the active command.
+// Pieces contiguous in physical memory are joined.
 static void
-idestart(struct buf *b)
+idesetprd(void)
 {
-  if(b == 0)
+  struct buf *b;
+  struct prd *p;
+  uint pa;
+
+  p = ideprd;
+  for(b = ideactive; b; b = b->qnext){
+    pa = V2P(b->data);
+    if(p > ideprd && p[-1].addr + p[-1].len == pa &&
+       (p[-1].addr >> 16) == ((pa + BSIZE - 1) >> 16) &&
+       p[-1].len + BSIZE < 0x10000)
+      p[-1].len += BSIZE;
+    else {
+      p->addr = pa;
+      p->len = BSIZE;
+      p->flags = 0;
+      p++;
+    }
+  }
+  p[-1].flags = PRD_EOT;
+}
+
+// Start the disk on the next request, merged with the
+// queued requests for the blocks right after it that go
+// the same direction.  Caller must hold idelock and the
+// disk must be idle.  Returns -1 if the drive rejects the
+// command; ideactive then holds the bufs to fail.
+static int
+idestart(void)
+{
+  struct buf **pp, *b, *tail;
+  int sector_per_block = BSIZE/SECTOR_SIZE;
+  int sector, mult, cmd;
+
+  if(ideactive != 0)
     panic("idestart");
-  if(b->blockno >= FSSIZE)
-    panic("incorrect blockno");
-  int sector_per_block =  BSIZE/SECTOR_SIZE;
-  int sector = b->blockno * sector_per_block;
-  int read_cmd = (sector_per_block == 1) ? IDE_CMD_READ :  IDE_CMD_RDMUL;
-  int write_cmd = (sector_per_block == 1) ? IDE_CMD_WRITE : IDE_CMD_WRMUL;
+  if(idequeue == 0)
+    return 0;
+
+  pp = idepick();
+  b = tail = *pp;
+  *pp = b->qnext;
+  idewrite = (b->flags & B_DIRTY) != 0;
+  idensect = sector_per_block;
+  while(*pp && IDEKEY(*pp) == IDEKEY(tail) + 1 &&
+        ((*pp)->flags & B_DIRTY) == (b->flags & B_DIRTY) &&
+        idensect + sector_per_block <= IDEMAXSECT){
+    tail->qnext = *pp;
+    tail = *pp;
+    *pp = tail->qnext;
+    idensect += sector_per_block;
+  }
+  tail->qnext = 0;
+  ideactive = idecur = b;
+  idedone = 0;
+  ideerr = 0;
+  idepos = IDEKEY(tail) + 1;
 
-  if (sector_per_block > 7) panic("idestart");
+  sector = b->blockno * sector_per_block;
+  mult = idemult[b->dev&1] > 1;
+  if(idebm)
+    cmd = idewrite ? IDE_CMD_WRDMA : IDE_CMD_RDDMA;
+  else if(idewrite)
+    cmd = mult ? IDE_CMD_WRMUL : IDE_CMD_WRITE;
+  else
+    cmd = mult ? IDE_CMD_RDMUL : IDE_CMD_READ;
+
+  if(idebm){
+    idesetprd();
+    outl(idebm+BM_PRDT, V2P(ideprd));
+    outb(idebm+BM_CMD, idewrite ? 0 : BM_READ);
+    outb(idebm+BM_STATUS, BM_ERR|BM_INTR);
+  }
 
   idewait(0);
   outb(0x3f6, 0);  // generate interrupt
-  outb(0x1f2, sector_per_block);  // number of sectors
+  outb(0x1f2, idensect & 0xff);  // number of sectors; 0 means 256
   outb(0x1f3, sector & 0xff);
   outb(0x1f4, (sector >> 8) & 0xff);
   outb(0x1f5, (sector >> 16) & 0xff);
   outb(0x1f6, 0xe0 | ((b->dev&1)<<4) | ((sector>>24)&0x0f));
-  if(b->flags & B_DIRTY){
-    outb(0x1f7, write_cmd);
-    outsl(0x1f0, b->data, BSIZE/4);
-  } else {
-    outb(0x1f7, read_cmd);
+  outb(0x1f7, cmd);
+  if(idebm){
+    // The controller moves all the data, then interrupts.
+    outb(idebm+BM_CMD, (idewrite ? 0 : BM_READ) | BM_START);
+  } else if(idewrite){
+    // The first sectors go out once the drive asks for
+    // them; each interrupt asks for more until the last
+    // one reports completion.  Give the drive 400ns to
+    // raise BSY before looking at the status.
+    inb(0x3f6); inb(0x3f6); inb(0x3f6); inb(0x3f6);
+    if(idewait(1) < 0 || (inb(0x1f7) & IDE_DRQ) == 0)
+      return -1;
+    idexfer();
+  }
+  return 0;
+}
+
+// Complete the bufs of a finished command, linked through
+// qnext: wake processes waiting for them, and release
+// buffers no one is waiting for.  If the drive failed the
+// command, mark them B_ERR rather than B_VALID.
+static void
+idefinish(struct buf *b, int err)
+{
+  struct buf *next;
+
+  for(; b; b = next){
+    next = b->qnext;
+    if(err)
+      b->flags |= B_ERR;
+    else {
+      b->flags |= B_VALID;
+      b->flags &= ~B_DIRTY;
+    }
+    if(b->flags & B_ASYNC){
+      b->flags &= ~B_ASYNC;
+      bdone(b);
+    } else
+      wakeup(b);
+  }
+}
+
+// Start the disk on the next request, failing those the
+// drive rejects.  Caller must hold idelock.
+static void
+idenext(void)
+{
+  struct buf *b;
+
+  while(idestart() < 0){
+    b = ideactive;
+    ideactive = 0;
+    idefinish(b, 1);
   }
 }
 
@@ -105,64 +348,147 @@ ideintr(void)
 {
   struct buf *b;
 
-  // First queued buffer is the active request.
   acquire(&idelock);
 
-  if((b = idequeue) == 0){
+  if(ideactive == 0){
     release(&idelock);
     return;
   }
-  idequeue = b->qnext;
 
-  // Read data if needed.
-  if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
-    insl(0x1f0, b->data, BSIZE/4);
-
-  // Wake process waiting for this buf.
-  b->flags |= B_VALID;
-  b->flags &= ~B_DIRTY;
-  wakeup(b);
+  if(idebm){
+    // Stop the controller; the transfer is over.
+    outb(idebm+BM_CMD, 0);
+    if(inb(idebm+BM_STATUS) & BM_ERR)
+      ideerr = 1;
+    outb(idebm+BM_STATUS, BM_ERR|BM_INTR);
+    if(idewait(1) < 0)
+      ideerr = 1;
+    idedone = idensect;
+  } else if(idewait(1) < 0){
+    // Give up on the rest of the command.
+    ideerr = 1;
+    idedone = idensect;
+  } else if(!idewrite){
+    // Read the sectors that arrived.
+    idexfer();
+  } else if(idedone < idensect){
+    // The drive wants more data; another interrupt will
+    // report when the last of it is written.
+    idexfer();
+    release(&idelock);
+    return;
+  }
+  if(idedone < idensect){
+    // More interrupts to come for this command.
+    release(&idelock);
+    return;
+  }
 
-  // Start disk on next buf in queue.
-  if(idequeue != 0)
-    idestart(idequeue);
+  // The command is finished.  Start the disk on the next
+  // request before completing this one's bufs.
+  b = ideactive;
+  ideactive = 0;
+  idenext();
+  idefinish(b, ideerr);
 
   release(&idelock);
 }
 
-//PAGEBREAK!
-// Sync buf with disk.
-// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
-// Else if B_VALID is not set, read buf from disk, set B_VALID.
-void
-iderw(struct buf *b)
+// Queue bs[0..n-1] in sector order and start the disk
+// if it is idle.
+static void
+ideput(struct buf **bs, int n)
 {
-  struct buf **pp;
-
-  if(!holdingsleep(&b->lock))
-    panic("iderw: buf not locked");
-  if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
-    panic("iderw: nothing to do");
-  if(b->dev != 0 && !havedisk1)
-    panic("iderw: ide disk 1 not present");
+  struct buf *b, **pp;
+  int i;
 
   acquire(&idelock);  //DOC:acquire-lock
 
-  // Append b to idequeue.
-  b->qnext = 0;
-  for(pp=&idequeue; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
-    ;
-  *pp = b;
+  for(i = 0; i < n; i++){
+    b = bs[i];
+    if(b->dev != 0 && !havedisk1)
+      panic("idesubmit: ide disk 1 not present");
+    if(b->blockno >= FSSIZE)
+      panic("incorrect blockno");
+
+    b->qtime = ticks;
+    for(pp=&idequeue; *pp && IDEKEY(*pp) < IDEKEY(b); pp=&(*pp)->qnext)  //DOC:insert-queue
+      ;
+    b->qnext = *pp;
+    *pp = b;
+  }
 
   // Start disk if necessary.
-  if(idequeue == b)
-    idestart(b);
+  if(ideactive == 0)
+    idenext();
 
-  // Wait for request to finish.
-  while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
-    sleep(b, &idelock);
+  release(&idelock);
+}
+
+//PAGEBREAK!
+// Queue the locked bufs bs[0..n-1] for the disk and return
+// without waiting.  Bufs with B_DIRTY set are written, the
+// others read.  When a transfer finishes, B_VALID is set and
+// B_DIRTY cleared; ideawait() waits for that.  A B_ASYNC
+// buf is instead released by bdone() from the interrupt.
+void
+idesubmit(struct buf **bs, int n)
+{
+  int i, j;
+
+  for(i = 0; i < n; i++){
+    if(!holdingsleep(&bs[i]->lock))
+      panic("idesubmit: buf not locked");
+    if((bs[i]->flags & (B_VALID|B_DIRTY)) == B_VALID)
+      panic("idesubmit: nothing to do");
+    bs[i]->flags &= ~B_ERR;
   }
 
+  // Split bs into runs for each driver.
+  for(i = 0; i < n; i = j){
+    for(j = i+1; j < n && ONVIRTIO(bs[j]) == ONVIRTIO(bs[i]); j++)
+      ;
+    if(ONVIRTIO(bs[i]))
+      virtiosubmit(bs+i, j-i);
+    else
+      ideput(bs+i, j-i);
+  }
+}
 
+// Wait for the transfer of b submitted by idesubmit().
+void
+ideawait(struct buf *b)
+{
+  if(ONVIRTIO(b)){
+    virtioawait(b);
+    return;
+  }
+  acquire(&idelock);
+  while((b->flags & (B_VALID|B_DIRTY)) != B_VALID && !(b->flags & B_ERR)){
+    sleep(b, &idelock);
+  }
   release(&idelock);
+  if(b->flags & B_ERR)
+    panic("ide: disk error");
+}
+
+// Sync buf with disk.
+// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
+// Else if B_VALID is not set, read buf from disk, set B_VALID.
+void
+iderw(struct buf *b)
+{
+  idesubmit(&b, 1);
+  ideawait(b);
+}
+
+// Start reading locked buf b from disk and return at once.
+// The interrupt handler sets B_VALID and releases b.
+void
+idereadahead(struct buf *b)
+{
+  if((b->flags & (B_VALID|B_DIRTY)) != 0)
+    panic("idereadahead");
+  b->flags |= B_ASYNC;
+  idesubmit(&b, 1);
 }
@@ -21,7 +21,8 @@ struct {
   struct spinlock lock;
   int use_lock;
   struct run *freelist;
-} kmem;
+  int nfree;           // Pages on freelist
+} __attribute__((aligned(CACHELINE))) kmem;
 
 // Initialization happens in two phases.
 // 1. main() calls kinit1() while still using entrypgdir to place just
@@ -72,6 +73,7 @@ kfree(char *v)
   r = (struct run*)v;
   r->next = kmem.freelist;
   kmem.freelist = r;
+  kmem.nfree++;
   if(kmem.use_lock)
     release(&kmem.lock);
 }
@@ -84,13 +86,27 @@ kalloc(void)
 {
   struct run *r;
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  if(kmem.use_lock)
-    release(&kmem.lock);
-  return (char*)r;
+  for(;;){
+    if(kmem.use_lock)
+      acquire(&kmem.lock);
+    r = kmem.freelist;
+    if(r){
+      kmem.freelist = r->next;
+      kmem.nfree--;
+    }
+    if(kmem.use_lock)
+      release(&kmem.lock);
+    // Out of pages: take some back from the buffer cache.
+    if(r || !kmem.use_lock || bshrink() == 0)
+      return (char*)r;
+  }
+}
+
+// Number of free pages, for callers deciding whether
+// memory is plentiful.  Not exact by the time it returns.
+int
+kfreecount(void)
+{
+  return kmem.nfree;
 }
 
@@ -4,6 +4,7 @@
 #include "param.h"
 #include "mmu.h"
 #include "proc.h"
+#include "spinlock.h"
 
 #define NULL 0
 
@@ -22,36 +23,48 @@ typedef union header Header;
 static Header base;
 static Header *freep;
 
+// kmalloc is used by the kernel itself (e.g. for proc
+// structures) as well as by the kmalloc system call.
+static struct spinlock kmlock;
+
+static void kmfree1(void *addr);
+
+void
+kminit(void)
+{
+  initlock(&kmlock, "kmalloc");
+}
+
+// Grow the heap by one page from kalloc().
+// Caller must hold kmlock.
 static Header*
-morecore(uint nu)
+morecore(void)
 {
   char *p;
   Header *hp;
 
-  if(nu < 4096)
-    nu = 4096;
-
   // replace sbrk with kalloc
   p = kalloc();
 
-  if(p == (char*)-1)
+  if(p == 0)
     return 0;
   hp = (Header*)p;
-  hp->s.size = nu;
-  kmfree((void*)(hp + 1));
+  hp->s.size = PGSIZE / sizeof(Header);
+  kmfree1((void*)(hp + 1));
   return freep;
 }
 
 void*
 kmalloc(uint nbytes)
 {
-  if (nbytes > 4096)
-    panic("kmalloc: requesting more than 4096 bytes");
+  if (nbytes > PGSIZE - sizeof(Header))
+    panic("kmalloc: requesting more than a page");
 
   Header *p, *prevp;
   uint nunits;
 
   nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
+  acquire(&kmlock);
   if((prevp = freep) == 0){
     base.s.ptr = freep = prevp = &base;
     base.s.size = 0;
@@ -66,16 +79,28 @@ kmalloc(uint nbytes)
         p->s.size = nunits;
       }
       freep = prevp;
+      release(&kmlock);
       return (void*)(p + 1);
     }
     if(p == freep)
-      if((p = morecore(nunits)) == 0)
+      if((p = morecore()) == 0){
+        release(&kmlock);
         return 0;
+      }
   }
 }
 
 void
 kmfree(void *addr)
+{
+  acquire(&kmlock);
+  kmfree1(addr);
+  release(&kmlock);
+}
+
+// Caller must hold kmlock.
+static void
+kmfree1(void *addr)
 {
   Header *bp, *p;
 
@@ -152,27 +177,31 @@ find_free_region(struct proc *curproc, void *addr, int length)
   return candidate;
 }
 
+// The caller must hold lockvm(curproc).
 struct mmregion*
 create_region(struct proc *curproc, void *addr, int length)
 {
+  int oldsz;
+
   // Allocate kernel space for new mmapped region entry
-  // TODO: check for errors
   // TODO: test_4 8000 allocation get's overwritten
   //  struct mmregion *node = (struct mmregion*)kmlloc(sizeof(struct mmregion));
   struct mmregion *new_region = (struct mmregion*)kalloc();
+  if (new_region == NULL)
+    return 0;
 
-  // New mmregion starts at address allocated in the heap
-  uint sz = curproc->sz;
-  new_region->addr = (void*)sz;
   new_region->length = length;
   new_region->rnext = NULL;
   new_region->rfree = 0;
   new_region->rsize = PGROUNDUP(length);
 
-  // Allocate user space
-  if ((sz = allocuvm(curproc->pgdir, sz, sz + new_region->rsize)) == 0)
+  // Allocate user space (growproc1 keeps threads' sz in step);
+  // the new mmregion starts at the old end of the heap
+  if ((oldsz = growproc1(new_region->rsize)) < 0) {
+    kfree((char*)new_region);
     return 0;
-  curproc->sz = sz;
+  }
+  new_region->addr = (void*)oldsz;
 
   // Add mmregion to proc's mmregion list in order
   struct mmregion *curr = curproc->mmregion_head;
@@ -184,6 +213,7 @@ create_region(struct proc *curproc, void *addr, int length)
     }
     insert_after(curr, new_region);
   }
+  shareuvm(curproc);
 
   return new_region;
 }
@@ -203,6 +233,10 @@ mmap(void *addr, int length, int prot, int flags, int fd, int offset)
   // TODO: if hit failure, undo free any allocations
 
   struct proc *curproc = myproc();
+  void *start;
+
+  // Threads sharing the address space share its region list
+  lockvm(curproc);
 
   // Try to re-use a freed, previously mmap'd region
   struct mmregion *free_region = find_free_region(curproc, addr, length);
@@ -210,12 +244,16 @@ mmap(void *addr, int length, int prot, int flags, int fd, int offset)
     // update region and return start address
     // TODO: does region need to be split into smaller pieces?
     // TODO: call map region
-    return free_region->addr;
+    start = free_region->addr;
+    unlockvm(curproc);
+    return start;
   }
 
   struct mmregion *new_region = create_region(curproc, addr, length);
+  start = new_region ? new_region->addr : 0;
+  unlockvm(curproc);
 
-  return new_region->addr;
+  return start;
 }
 
 int
@@ -223,9 +261,12 @@ munmap(void *addr, int length)
 {
   struct proc *curproc = myproc();
 
+  lockvm(curproc);
   struct mmregion *mmregion = find_region(curproc, addr, length);
-  if (mmregion == NULL)
+  if (mmregion == NULL) {
+    unlockvm(curproc);
     return -1;
+  }
 
   // clear data previously mapped to region
   memset(addr, 0, length);
@@ -234,6 +275,7 @@ munmap(void *addr, int length)
   mmregion->rfree = 1;
 
   merge_free_regions(curproc);
+  unlockvm(curproc);
 
   return 0;
 
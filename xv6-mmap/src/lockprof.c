@@ -0,0 +1,159 @@
+// Lock contention profiler.
+//
+// Every spinlock and sleeplock points at the lockclass for its
+// name and type, looked up once by initlock()/initsleeplock().
+// acquire() and release() add to the class's per-cpu counters,
+// so the counters need no lock of their own and no cache line
+// is shared between cpus: the caller always has interrupts off.
+// lockstat() sums the cpus.
+//
+// Build with LOCKSTAT=0 to compile the profiler out; the lock
+// structs and the acquire/release paths are then unchanged.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "x86.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "percpu.h"
+#include "lockstat.h"
+
+#ifdef LOCKSTAT
+
+struct lockcount {
+  uint nacquire;
+  uint ncontend;
+  uint64 wait;
+  uint64 hold;
+  uint64 holdmax;
+};
+
+struct lockclass {
+  char name[16];
+  int type;
+};
+
+// initlock() runs before mycpu() works, so the class table
+// is guarded by a bare xchg flag rather than a spinlock.
+static struct {
+  uint busy;
+  int n;
+  struct lockclass class[NLOCKCLASS];
+} lstable;
+
+// Counters for lstable.class[i] are in lockcount[i].
+static DEFINE_PERCPU(struct lockcount, lockcount[NLOCKCLASS]);
+
+// Return the class for locks named name, adding it if needed.
+// Returns 0 if the table is full; such locks are not counted.
+struct lockclass*
+lockclass(char *name, int type)
+{
+  struct lockclass *lc;
+
+  while(xchg(&lstable.busy, 1) != 0)
+    ;
+  for(lc = lstable.class; lc < &lstable.class[lstable.n]; lc++)
+    if(lc->type == type && strncmp(lc->name, name, sizeof(lc->name)-1) == 0)
+      goto found;
+  if(lstable.n < NLOCKCLASS){
+    lc = &lstable.class[lstable.n++];
+    safestrcpy(lc->name, name, sizeof(lc->name));
+    lc->type = type;
+  } else
+    lc = 0;
+found:
+  xchg(&lstable.busy, 0);
+  return lc;
+}
+
+// Called with interrupts off just after a lock is acquired.
+void
+lockacquired(struct lockclass *lc, struct cpu *c, int contended, uint64 wait)
+{
+  struct lockcount *lcnt;
+
+  if(lc == 0)
+    return;
+  lcnt = percpu_ptr(lockcount[lc - lstable.class], c);
+  lcnt->nacquire++;
+  if(contended){
+    lcnt->ncontend++;
+    lcnt->wait += wait;
+  }
+}
+
+// Called with interrupts off just before a lock is released.
+void
+lockreleased(struct lockclass *lc, struct cpu *c, uint64 held)
+{
+  struct lockcount *lcnt;
+
+  if(lc == 0)
+    return;
+  lcnt = percpu_ptr(lockcount[lc - lstable.class], c);
+  lcnt->hold += held;
+  if(held > lcnt->holdmax)
+    lcnt->holdmax = held;
+}
+
+static uint
+kcycles(uint64 x)
+{
+  x >>= 10;
+  return x > 0xffffffff ? 0xffffffff : (uint)x;
+}
+
+// Copy up to n classes into li, summed over cpus, and zero
+// the counters if reset is set.  Returns the number copied.
+int
+lockstat(struct lockinfo *li, int n, int reset)
+{
+  struct lockclass *lc;
+  struct lockcount sum, *lcnt;
+  struct cpu *c;
+  int i, nclass;
+
+  nclass = lstable.n;
+  if(n > nclass)
+    n = nclass;
+  for(i = 0; i < n; i++){
+    lc = &lstable.class[i];
+    memset(&sum, 0, sizeof(sum));
+    for(c = cpus; c < cpus+ncpu; c++){
+      lcnt = percpu_ptr(lockcount[i], c);
+      sum.nacquire += lcnt->nacquire;
+      sum.ncontend += lcnt->ncontend;
+      sum.wait += lcnt->wait;
+      sum.hold += lcnt->hold;
+      if(lcnt->holdmax > sum.holdmax)
+        sum.holdmax = lcnt->holdmax;
+    }
+    safestrcpy(li[i].name, lc->name, sizeof(li[i].name));
+    li[i].type = lc->type;
+    li[i].nacquire = sum.nacquire;
+    li[i].ncontend = sum.ncontend;
+    li[i].waitk = kcycles(sum.wait);
+    li[i].holdk = kcycles(sum.hold);
+    li[i].holdmaxk = kcycles(sum.holdmax);
+  }
+  // Counters updated concurrently on other cpus may survive
+  // the reset; that is fine for statistics.
+  if(reset)
+    for(c = cpus; c < cpus+ncpu; c++)
+      memset(percpu_ptr(lockcount[0], c), 0, nclass*sizeof(struct lockcount));
+  return n;
+}
+
+#else
+
+int
+lockstat(struct lockinfo *li, int n, int reset)
+{
+  return -1;
+}
+
+#endif
@@ -0,0 +1,71 @@
+// Show kernel lock contention statistics, most waited-on first.
+// usage: lockstat [-r]
+// -r resets the counters after printing them.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "lockstat.h"
+
+struct lockinfo info[NLOCKCLASS];
+
+// Print x right-aligned in a field of width w.
+void
+printpad(uint x, int w)
+{
+  int n;
+  uint y;
+
+  n = 1;
+  for(y = x; y >= 10; y /= 10)
+    n++;
+  for(; n < w; n++)
+    printf(1, " ");
+  printf(1, "%d", x);
+}
+
+// Sort by total wait, largest first.
+void
+sort(struct lockinfo *li, int n)
+{
+  struct lockinfo t;
+  int i, j;
+
+  for(i = 1; i < n; i++){
+    t = li[i];
+    for(j = i; j > 0 && li[j-1].waitk < t.waitk; j--)
+      li[j] = li[j-1];
+    li[j] = t;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, j, n, reset;
+  struct lockinfo *li;
+
+  reset = argc > 1 && strcmp(argv[1], "-r") == 0;
+  if((n = lockstat(info, NLOCKCLASS, reset)) < 0){
+    printf(2, "lockstat: kernel built without LOCKSTAT\n");
+    exit();
+  }
+  sort(info, n);
+
+  printf(1, "NAME            TYPE     ACQUIRE  CONTEND  WAITK     HOLDK    MAXK\n");
+  for(i = 0; i < n; i++){
+    li = &info[i];
+    printf(1, "%s", li->name);
+    for(j = strlen(li->name); j < 16; j++)
+      printf(1, " ");
+    printf(1, "%s", li->type == LOCKSLEEP ? "sleep" : "spin ");
+    printpad(li->nacquire, 10);
+    printpad(li->ncontend, 9);
+    printpad(li->waitk, 9);
+    printpad(li->holdk, 10);
+    printpad(li->holdmaxk, 8);
+    printf(1, "\n");
+  }
+  exit();
+}
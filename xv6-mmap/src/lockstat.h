@@ -0,0 +1,16 @@
+// Lock contention statistics returned by lockstat().
+// Both the kernel and user programs use this header file.
+// Locks with the same name are counted together.
+
+#define LOCKSPIN   0  // struct spinlock
+#define LOCKSLEEP  1  // struct sleeplock
+
+struct lockinfo {
+  char name[16];
+  int type;               // LOCKSPIN or LOCKSLEEP
+  uint nacquire;          // Acquisitions
+  uint ncontend;          // Acquisitions that had to wait
+  uint waitk;             // Total wait, in 1024-cycle units
+  uint holdk;             // Total hold time, in 1024-cycle units
+  uint holdmaxk;          // Longest hold, in 1024-cycle units
+};
@@ -5,50 +5,127 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "mmu.h"
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
 
 // Simple logging that allows concurrent FS system calls.
 //
 // A log transaction contains the updates of multiple FS system
-// calls. The logging system only commits when there are
-// no FS system calls active. Thus there is never
+// calls. A transaction is only closed when there are
+// no FS system calls active in it. Thus there is never
 // any reasoning required about whether a commit might
 // write an uncommitted system call's updates to disk.
 //
 // A system call should call begin_op()/end_op() to mark
-// its start and end. Usually begin_op() just increments
-// the count of in-progress FS system calls and returns.
-// But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// its start and end, which reserve and free the space its
+// updates might need in the open transaction: sb.opblocks
+// blocks, or as many as it asks for with begin_opn()/end_opn().
+// Usually begin_op() just increments the count of
+// in-progress FS system calls and returns, and end_op()
+// just decrements it: updates stay in the
+// buffer cache, and the logflush kernel thread commits
+// them once the oldest is LOGFLUSH ticks old.  But if
+// begin_op() thinks the open transaction is close to
+// running out of space, it asks for a commit and waits.
+// log_sync() forces a commit for sync() and fsync().
 //
 // The log is a physical re-do log containing disk blocks.
-// The on-disk log format:
-//   header block, containing block #s for block A, B, C, ...
+// Committed transactions are appended to it one after
+// another.  A commit writes the transaction's header and
+// blocks in one batch, the blocks straight from the buffer
+// cache; the header holds a checksum of them all, so it
+// is a valid commit record only once the whole batch is on
+// disk.  Closing a transaction only locks its buffers, so
+// FS system calls that do not use them carry on while it
+// is written.
+//
+// With sb.ordered set, file data blocks that log_data() is
+// given are not logged: commit() writes them in place just
+// before the transaction, so that no committed metadata
+// points at stale data.
+//
+// Committed blocks stay pinned in the cache and are only
+// installed in their home locations when the log is too
+// full for another transaction.  That checkpoint then
+// empties the log by advancing the sequence # in the log's
+// first block, which makes the old headers stale.
+// Recovery replays the transactions that follow, in order,
+// up to the first header that is stale or whose checksum
+// does not match.
+//
+// The on-disk format of the log:
+//   sequence # of the first transaction
+//   header block, containing sequence #, checksum and block #s for block A, B, ...
 //   block A
 //   block B
-//   block C
 //   ...
-// Log appends are synchronous.
+//   header block of the next transaction
+//   ...
+// Log appends are synchronous, but happen at commit, not in
+// each system call.  They go around the buffer cache, so
+// log blocks are never read through it after recovery.
+
+#define LOGMAGIC 0x10c0ffee
+#define SUMINIT  2166136261
+#define NFREEPG  8  // pages of log.freed; 32768 blocks each
+#define NORD     (PGSIZE/sizeof(int))  // max data blocks in a transaction
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
 struct logheader {
+  uint magic;
+  uint seq;        // commit order
+  uint sum;        // checksum of the blocks and header
   int n;
   int block[LOGSIZE];
 };
 
+// Contents of the log's first block.
+struct logsuper {
+  uint seq;        // sequence # of the first transaction
+};
+
 struct log {
   struct spinlock lock;
   int start;
   int size;
+  int trans;       // max blocks in a transaction
+  int opblocks;    // blocks begin_op() reserves
   int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
+  int reserved;    // blocks they have reserved
+  int dreserved;   // and data blocks, for log_data()
+  int ordered;     // log_data() writes data in place
+  int closing;     // in close_trans(), please wait.
+  int committing;  // a closed transaction is being committed.
+  int want;        // commit once outstanding drops to 0.
+  uint ncommit;    // commits finished
+  uint dirtytick;  // ticks when lh became non-empty
   int dev;
-  struct logheader lh;
+  uint seq;        // sequence # of the next transaction
+  int head;        // where the next transaction goes
+  int *ckpt;       // committed blocks not yet installed
+  int nckpt;
+  struct logheader lh;  // open transaction
+  int nord;
+  int *ord;             // and its data blocks, written in place
+  int nfreed;           // and blocks it frees, not to be reused
+  uchar *freed[NFREEPG];  // until it is closed; a bit per block
+  struct logheader cl;  // closed transaction
+  int nclord;
+  int *clord;
+  int clpos;            // and where it goes in the log
+  struct buf *cbuf[LOGSIZE];  // its cache buffers, locked
+  struct buf **dbuf;          // and those of its data
+  struct buf lbuf[LOGSIZE+1]; // and the log blocks they go to
+  struct buf *bs[LOGSIZE+1];  // for bwritev()
 };
 struct log log;
 
 static void recover_from_log(void);
 static void commit();
+static void checkpoint(void);
+static void logflusher(void);
 
 void
 initlog(int dev)
@@ -57,103 +134,313 @@ initlog(int dev)
     panic("initlog: too big logheader");
 
   struct superblock sb;
+  int i;
+
   initlock(&log.lock, "log");
   readsb(dev, &sb);
   log.start = sb.logstart;
   log.size = sb.nlog;
+  log.trans = sb.logtrans;
+  log.opblocks = sb.opblocks;
+  log.ordered = sb.ordered;
   log.dev = dev;
+  if(log.trans > LOGSIZE || log.opblocks > log.trans ||
+     log.size < log.trans+2 || log.size > PGSIZE/sizeof(int))
+    panic("initlog: log size");
+  if((log.ckpt = (int*)kalloc()) == 0 ||
+     (log.lbuf[0].data = (uchar*)kalloc()) == 0 ||
+     (log.ord = (int*)kalloc()) == 0 ||
+     (log.clord = (int*)kalloc()) == 0 ||
+     (log.dbuf = (struct buf**)kalloc()) == 0)
+    panic("initlog: kalloc");
+  if(sb.size > NFREEPG*PGSIZE*8)
+    panic("initlog: fs too big");
+  for(i = 0; i*PGSIZE*8 < sb.size; i++){
+    if((log.freed[i] = (uchar*)kalloc()) == 0)
+      panic("initlog: kalloc");
+    memset(log.freed[i], 0, PGSIZE);
+  }
+  // The log blocks of a transaction borrow the data of its
+  // cache buffers; the header has a page of its own.
+  for(i = 0; i <= LOGSIZE; i++){
+    initsleeplock(&log.lbuf[i].lock, "logbuf");
+    log.lbuf[i].dev = dev;
+  }
   recover_from_log();
+  if(kthread(logflusher, "logflush") < 0)
+    panic("initlog: logflush");
 }
 
-// Copy committed blocks from log to their home location
-static void
-install_trans(void)
+// Fold n words at p into checksum sum.
+static uint
+cksum(uint sum, void *p, int n)
 {
-  int tail;
+  uint *w = p;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    brelse(lbuf);
-    brelse(dbuf);
-  }
+  while(n-- > 0)
+    sum = (sum ^ *w++) * 16777619;
+  return sum;
 }
 
-// Read the log header from disk into the in-memory log header
-static void
-read_head(void)
+static uint
+cksumhead(uint sum, struct logheader *lh)
 {
-  struct buf *buf = bread(log.dev, log.start);
-  struct logheader *lh = (struct logheader *) (buf->data);
+  sum = cksum(sum, &lh->seq, 1);
+  sum = cksum(sum, &lh->n, 1);
+  return cksum(sum, lh->block, lh->n);
+}
+
+// Read the header at log block pos into *lh, and check
+// that it commits transaction seq.  Leaves the
+// transaction's blocks in the cache.
+static int
+read_head(int pos, uint seq, struct logheader *lh)
+{
+  struct buf *buf = bread(log.dev, log.start+pos);
+  struct logheader *hb = (struct logheader *) (buf->data);
+  uint sum;
   int i;
-  log.lh.n = lh->n;
-  for (i = 0; i < log.lh.n; i++) {
-    log.lh.block[i] = lh->block[i];
-  }
+
+  *lh = *hb;
   brelse(buf);
+  if (lh->magic != LOGMAGIC || lh->seq != seq ||
+      lh->n < 1 || lh->n > log.trans || pos+1+lh->n > log.size)
+    return 0;
+  sum = SUMINIT;
+  for (i = 0; i < lh->n; i++) {
+    buf = bread(log.dev, log.start+pos+1+i);
+    sum = cksum(sum, buf->data, BSIZE/sizeof(uint));
+    brelse(buf);
+  }
+  return cksumhead(sum, lh) == lh->sum;
 }
 
-// Write in-memory log header to disk.
-// This is the true point at which the
-// current transaction commits.
+// Write the sequence # of the log's first transaction.
 static void
-write_head(void)
+write_super(uint seq)
 {
   struct buf *buf = bread(log.dev, log.start);
-  struct logheader *hb = (struct logheader *) (buf->data);
-  int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
-  }
+  struct logsuper *ls = (struct logsuper *) (buf->data);
+
+  ls->seq = seq;
   bwrite(buf);
   brelse(buf);
 }
 
+// Copy the committed transaction at log block pos to
+// the home locations.  The writes go to the disk LOGBATCH
+// at a time, so it can sort them and merge neighbours.
+static void
+install_trans(int pos, struct logheader *lh)
+{
+  struct buf *dbuf[LOGBATCH];
+  int tail, i, n;
+
+  for (tail = 0; tail < lh->n; tail += n) {
+    n = min(LOGBATCH, lh->n - tail);
+    for (i = 0; i < n; i++) {
+      struct buf *lbuf = bread(log.dev, log.start+pos+1+tail+i); // read log block
+      dbuf[i] = bread(log.dev, lh->block[tail+i]); // read dst
+      memmove(dbuf[i]->data, lbuf->data, BSIZE);  // copy block to dst
+      brelse(lbuf);
+    }
+    bwritev(dbuf, n);  // write dsts to disk
+    for (i = 0; i < n; i++)
+      brelse(dbuf[i]);
+  }
+}
+
 static void
 recover_from_log(void)
 {
-  read_head();
-  install_trans(); // if committed, copy from log to disk
+  struct buf *buf = bread(log.dev, log.start);
+  uint seq = ((struct logsuper *) (buf->data))->seq;
+  int pos;
+
+  brelse(buf);
+  log.seq = seq;
+  // if committed, copy from log to disk
+  for (pos = 1; pos < log.size; pos += 1+log.lh.n) {
+    if (!read_head(pos, log.seq, &log.lh))
+      break;
+    install_trans(pos, &log.lh);
+    log.seq++;
+  }
+  if (log.seq != seq)
+    write_super(log.seq); // clear the log
+  log.lh.n = 0;
+  log.head = 1;
+}
+
+// Is block blockno in the open transaction, or in the log
+// waiting for checkpoint()?  Caller must hold log.lock.
+static int
+inlog(uint blockno)
+{
+  int i;
+
+  for (i = 0; i < log.lh.n; i++)
+    if (log.lh.block[i] == blockno)
+      return 1;
+  for (i = 0; i < log.nckpt; i++)
+    if (log.ckpt[i] == blockno)
+      return 1;
+  return 0;
+}
+
+// Close the open transaction: lock its buffers, so that
+// they hold its updates until they are in the log, and
+// open the next transaction.  If the log will then be too
+// full for another transaction, the next one stays closed
+// until a checkpoint has emptied it; returns 1 if so.
+// Caller must hold log.lock, no FS system call may be
+// executing and no commit be in progress.  begin_op()
+// waits while the lock is dropped.
+static int
+close_trans(void)
+{
+  int i, full, *t;
+
+  log.closing = 1;
+  log.committing = 1;
+  log.want = 0;
+  log.cl = log.lh;
+  log.clpos = log.head;
+  if (log.cl.n > 0) {
+    log.cl.seq = log.seq++;
+    log.head += 1 + log.cl.n;
+  }
+  full = log.head + 1 + log.trans > log.size;
   log.lh.n = 0;
-  write_head(); // clear the log
+  t = log.clord;
+  log.clord = log.ord;
+  log.ord = t;
+  log.nclord = log.nord;
+  log.nord = 0;
+  // Blocks the closed transaction frees may be reused: any
+  // data written to them in place goes to disk only after
+  // it has committed.
+  if (log.nfreed > 0) {
+    for (i = 0; i < NFREEPG && log.freed[i]; i++)
+      memset(log.freed[i], 0, PGSIZE);
+    log.nfreed = 0;
+  }
+  release(&log.lock);
+
+  for (i = 0; i < log.cl.n; i++)
+    log.cbuf[i] = bread(log.dev, log.cl.block[i]);
+  for (i = 0; i < log.nclord; i++)
+    log.dbuf[i] = bread(log.dev, log.clord[i]);
+
+  acquire(&log.lock);
+  if (!full) {
+    log.closing = 0;
+    wakeup(&log);
+  }
+  return full;
 }
 
-// called at the start of each FS system call.
+// Commit transactions while one is wanted and can be
+// closed.  Caller must hold log.lock, which is dropped
+// while a transaction is written.
+static void
+docommit(void)
+{
+  int full;
+
+  while(log.want && log.outstanding == 0 && !log.committing){
+    if(log.lh.n + log.nord == 0){
+      log.want = 0;
+      wakeup(&log);
+      break;
+    }
+    full = close_trans();
+    // call commit w/o holding locks, since not allowed
+    // to sleep with locks.
+    release(&log.lock);
+    commit();
+    if(full)
+      checkpoint();
+    acquire(&log.lock);
+    if(full){
+      log.head = 1;
+      log.closing = 0;
+    }
+    log.committing = 0;
+    log.ncommit++;
+    wakeup(&log);
+  }
+}
+
+// called at the start of an FS system call that may
+// log_write() up to n blocks and log_data() up to nd.
+// Data blocks are only logged without sb.ordered.
 void
-begin_op(void)
+begin_opn(int n, int nd)
 {
+  if(!log.ordered){
+    n += nd;
+    nd = 0;
+  }
+  if(n > log.trans || nd > NORD)
+    panic("begin_op: too many blocks");
   acquire(&log.lock);
   while(1){
-    if(log.committing){
-      sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
-      // this op might exhaust log space; wait for commit.
+    if(log.closing || log.want){
       sleep(&log, &log.lock);
+    } else if(log.lh.n + log.reserved + n > log.trans ||
+              log.nord + log.dreserved + nd > NORD){
+      // this op might exhaust the open transaction's
+      // space; commit it first.
+      log.want = 1;
+      docommit();
     } else {
       log.outstanding += 1;
+      log.reserved += n;
+      log.dreserved += nd;
       release(&log.lock);
       break;
     }
   }
 }
 
-// called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// called at the start of each FS system call.
 void
-end_op(void)
+begin_op(void)
+{
+  begin_opn(log.opblocks, 0);
+}
+
+// Most data blocks an FS system call that also changes up
+// to n other blocks should pass to log_data().  Without
+// sb.ordered that is what is left of a transaction; with
+// it, a quarter of the transaction's data, so that a few
+// such calls share a commit.
+int
+log_datamax(int n)
 {
-  int do_commit = 0;
+  return log.ordered ? NORD/4 : log.trans - n;
+}
 
+// called at the end of an FS system call started
+// with begin_opn(n, nd).
+// commits if this was the last outstanding operation
+// and a commit is wanted.
+void
+end_opn(int n, int nd)
+{
+  if(!log.ordered){
+    n += nd;
+    nd = 0;
+  }
   acquire(&log.lock);
   log.outstanding -= 1;
-  if(log.committing)
-    panic("log.committing");
-  if(log.outstanding == 0){
-    do_commit = 1;
-    log.committing = 1;
+  log.reserved -= n;
+  log.dreserved -= nd;
+  if(log.closing)
+    panic("log.closing");
+  if(log.outstanding == 0 && log.want){
+    docommit();
   } else {
     // begin_op() may be waiting for log space,
     // and decrementing log.outstanding has decreased
@@ -161,49 +448,138 @@ end_op(void)
     wakeup(&log);
   }
   release(&log.lock);
+}
 
-  if(do_commit){
-    // call commit w/o holding locks, since not allowed
-    // to sleep with locks.
-    commit();
-    acquire(&log.lock);
-    log.committing = 0;
-    wakeup(&log);
-    release(&log.lock);
+// called at the end of each FS system call.
+void
+end_op(void)
+{
+  end_opn(log.opblocks, 0);
+}
+
+// Wait until the updates of every FS system call that
+// has finished are on disk.
+void
+log_sync(void)
+{
+  uint target;
+
+  acquire(&log.lock);
+  // The updates are in the transaction being committed,
+  // if any, or in the open one.
+  target = log.ncommit + log.committing + (log.lh.n + log.nord > 0);
+  if(log.lh.n + log.nord > 0)
+    log.want = 1;
+  while((int)(log.ncommit - target) < 0){
+    docommit();
+    if((int)(log.ncommit - target) < 0)
+      sleep(&log, &log.lock);
+  }
+  release(&log.lock);
+}
+
+// Body of the logflush kernel thread.  Once the oldest
+// update in the open transaction is LOGFLUSH ticks old,
+// commit it, so that end_op() need not.  While the
+// transaction is empty, sleep until log_write() or
+// log_data() dirties it rather than on every tick.
+static void
+logflusher(void)
+{
+  acquire(&log.lock);
+  for(;;){
+    if(log.lh.n + log.nord == 0){
+      sleep(&log.dirtytick, &log.lock);
+      continue;
+    }
+    if(!log.want && ticks - log.dirtytick >= LOGFLUSH){
+      log.want = 1;
+      docommit();
+      continue;
+    }
+    sleep(&ticks, &log.lock);
   }
 }
 
-// Copy modified blocks from cache to log.
+// Install every committed block in its home location and
+// empty the log.  No FS system call may be executing, so
+// the cache holds exactly the committed contents.  The
+// writes are started one by one and release their buffers
+// when done, so the disk can sort them.
 static void
-write_log(void)
+checkpoint(void)
 {
-  int tail;
+  int i;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
-    brelse(from);
-    brelse(to);
-  }
+  for (i = 0; i < log.nckpt; i++)
+    bawrite(bread(log.dev, log.ckpt[i]));
+  // Each buffer is unlocked once its write is done.
+  for (i = 0; i < log.nckpt; i++)
+    brelse(bread(log.dev, log.ckpt[i]));
+  write_super(log.seq);
+  log.nckpt = 0;
 }
 
+// Write the closed transaction's data in place, then its
+// header and blocks to the log in one batch.  This is the
+// true point at which the transaction commits.
 static void
 commit()
 {
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(); // Now install writes to home locations
-    log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+  struct logheader *hb = (struct logheader *) (log.lbuf[0].data);
+  struct buf **bs = log.bs;
+  struct buf *b;
+  uint sum;
+  int i, j;
+
+  if (log.nclord > 0) {
+    bwritev(log.dbuf, log.nclord);
+    for (i = 0; i < log.nclord; i++)
+      brelse(log.dbuf[i]);
+  }
+  if (log.cl.n == 0)
+    return;
+
+  sum = SUMINIT;
+  for (i = 0; i < log.cl.n; i++) {
+    b = &log.lbuf[i+1];
+    acquiresleep(&b->lock);
+    b->blockno = log.start+log.clpos+1+i;
+    b->data = log.cbuf[i]->data;
+    b->flags = B_VALID;
+    sum = cksum(sum, b->data, BSIZE/sizeof(uint));
+    bs[i+1] = b;
+  }
+  log.cl.magic = LOGMAGIC;
+  log.cl.sum = cksumhead(sum, &log.cl);
+  b = &log.lbuf[0];
+  acquiresleep(&b->lock);
+  b->blockno = log.start+log.clpos;
+  b->flags = B_VALID;
+  memmove(hb, &log.cl, sizeof(log.cl));
+  bs[0] = b;
+  bwritev(bs, log.cl.n+1);
+  for (i = 0; i <= log.cl.n; i++)
+    releasesleep(&log.lbuf[i].lock);
+
+  // The blocks stay pinned until checkpoint() installs them.
+  acquire(&log.lock);
+  for (i = 0; i < log.cl.n; i++) {
+    for (j = 0; j < log.nckpt; j++)
+      if (log.ckpt[j] == log.cl.block[i])
+        break;
+    if (j == log.nckpt)
+      log.ckpt[log.nckpt++] = log.cl.block[i];
   }
+  release(&log.lock);
+  for (i = 0; i < log.cl.n; i++)
+    brelse(log.cbuf[i]);
 }
 
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache with B_DIRTY.
-// commit()/write_log() will do the disk write.
+// commit() will write it to the log, and checkpoint()
+// to its home location.
 //
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
@@ -215,7 +591,7 @@ log_write(struct buf *b)
 {
   int i;
 
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
+  if (log.lh.n >= log.trans)
     panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
@@ -225,10 +601,93 @@ log_write(struct buf *b)
     if (log.lh.block[i] == b->blockno)   // log absorbtion
       break;
   }
+  if (log.lh.n + log.nord == 0) {
+    log.dirtytick = ticks;
+    wakeup(&log.dirtytick);
+  }
   log.lh.block[i] = b->blockno;
   if (i == log.lh.n)
     log.lh.n++;
+  // A freed data block may have become metadata; it must
+  // not be written in place before the commit.
+  for (i = 0; i < log.nord; i++) {
+    if (log.ord[i] == b->blockno) {
+      log.ord[i] = log.ord[--log.nord];
+      break;
+    }
+  }
+  b->flags |= B_DIRTY; // prevent eviction
+  release(&log.lock);
+}
+
+// Caller has modified b->data, a block of file data, and
+// is done with the buffer.  Like log_write(), but with
+// sb.ordered set commit() writes the block in place rather
+// than logging it.  A block the log holds an older copy of
+// is logged all the same, lest recovery replay that copy
+// over the new data.
+void
+log_data(struct buf *b)
+{
+  int i;
+
+  if (!log.ordered) {
+    log_write(b);
+    return;
+  }
+  if (log.nord >= NORD)
+    panic("too big a transaction");
+  if (log.outstanding < 1)
+    panic("log_data outside of trans");
+
+  acquire(&log.lock);
+  if (inlog(b->blockno)) {
+    release(&log.lock);
+    log_write(b);
+    return;
+  }
+  for (i = 0; i < log.nord; i++) {
+    if (log.ord[i] == b->blockno)
+      break;
+  }
+  if (log.lh.n + log.nord == 0) {
+    log.dirtytick = ticks;
+    wakeup(&log.dirtytick);
+  }
+  log.ord[i] = b->blockno;
+  if (i == log.nord)
+    log.nord++;
   b->flags |= B_DIRTY; // prevent eviction
   release(&log.lock);
 }
 
+// Called by bfree() when the open transaction frees block
+// blockno.  Until the transaction commits the block still
+// belongs to its old owner on disk, so balloc() must not
+// hand it out, lest data be written in place over it.
+// Nor may it hand out a block the log holds a copy of, which
+// recovery would replay over the data; so with sb.ordered a
+// file data block is never in the log, and log_data() never
+// needs log space for it.
+void
+log_free(uint blockno)
+{
+  acquire(&log.lock);
+  log.freed[blockno/(PGSIZE*8)][blockno/8%PGSIZE] |= 1 << (blockno%8);
+  log.nfreed++;
+  release(&log.lock);
+}
+
+// Must balloc() pass over block blockno?
+int
+log_busy(uint blockno)
+{
+  int r;
+
+  acquire(&log.lock);
+  r = (log.freed[blockno/(PGSIZE*8)][blockno/8%PGSIZE] >> (blockno%8)) & 1;
+  if (!r)
+    r = inlog(blockno);
+  release(&log.lock);
+  return r;
+}
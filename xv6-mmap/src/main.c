@@ -21,11 +21,13 @@ main(void)
   kvmalloc();      // kernel page table
   mpinit();        // detect other processors
   lapicinit();     // interrupt controller
+  percpuinit();    // per-cpu variables
   seginit();       // segment descriptors
   picinit();       // disable pic
   ioapicinit();    // another interrupt controller
   consoleinit();   // console hardware
   uartinit();      // serial port
+  kminit();        // kernel heap
   pinit();         // process table
   tvinit();        // trap vectors
   binit();         // buffer cache
@@ -13,7 +13,7 @@
 #include "fs.h"
 #include "buf.h"
 
-extern uchar _binary_fs_img_start[], _binary_fs_img_size[];
+extern uchar _binary_memfs_img_start[], _binary_memfs_img_size[];
 
 static int disksize;
 static uchar *memdisk;
@@ -21,8 +21,8 @@ static uchar *memdisk;
 void
 ideinit(void)
 {
-  memdisk = _binary_fs_img_start;
-  disksize = (uint)_binary_fs_img_size/BSIZE;
+  memdisk = _binary_memfs_img_start;
+  disksize = (uint)_binary_memfs_img_size/BSIZE;
 }
 
 // Interrupt handler.
@@ -58,3 +58,35 @@ iderw(struct buf *b)
     memmove(b->data, p, BSIZE);
   b->flags |= B_VALID;
 }
+
+// The memory disk is synchronous, so submitted bufs are
+// done before idesubmit() returns.
+void
+idesubmit(struct buf **bs, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++){
+    if(bs[i]->flags & B_ASYNC){
+      bs[i]->flags &= ~B_ASYNC;
+      iderw(bs[i]);
+      bdone(bs[i]);
+    } else
+      iderw(bs[i]);
+  }
+}
+
+void
+ideawait(struct buf *b)
+{
+  if((b->flags & (B_VALID|B_DIRTY)) != B_VALID)
+    panic("ideawait");
+}
+
+// The memory disk is synchronous, so read-ahead just reads.
+void
+idereadahead(struct buf *b)
+{
+  iderw(b);
+  bdone(b);
+}
@@ -20,9 +20,12 @@
 // Disk layout:
 // [ boot block | sb block | log | inode blocks | free bit map | data blocks ]
 
-int nbitmap = FSSIZE/(BSIZE*8) + 1;
+int fssize = FSSIZE;  // -m: MEMFSSIZE, for kernelmemfs
+int nbitmap;
 int ninodeblocks = NINODES / IPB + 1;
-int nlog = LOGSIZE;
+int logtrans;  // Max blocks in a log transaction
+int nlog;
+int ordered = 1;  // Log only metadata; -j logs file data too
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
@@ -76,8 +79,16 @@ main(int argc, char *argv[])
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
+  for(; argc > 1 && argv[1][0] == '-'; argc--, argv++){
+    if(strcmp(argv[1], "-j") == 0)
+      ordered = 0;
+    else if(strcmp(argv[1], "-m") == 0)
+      fssize = MEMFSSIZE;
+    else
+      argc = 0;
+  }
   if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+    fprintf(stderr, "Usage: mkfs [-j] [-m] fs.img files...\n");
     exit(1);
   }
 
@@ -90,24 +101,37 @@ main(int argc, char *argv[])
     exit(1);
   }
 
-  // 1 fs block = 1 disk sector
+  // 1 fs block = BSIZE/512 disk sectors
+  nbitmap = fssize/(BSIZE*8) + 1;
+  // A transaction of 1/64th of the disk, within bounds; the log
+  // has its first block, then room for 2 of them.
+  logtrans = fssize/64;
+  if(logtrans < 2*MAXOPBLOCKS)
+    logtrans = 2*MAXOPBLOCKS;
+  if(logtrans > LOGSIZE)
+    logtrans = LOGSIZE;
+  nlog = 1 + 2*(logtrans+1);
   nmeta = 2 + nlog + ninodeblocks + nbitmap;
-  nblocks = FSSIZE - nmeta;
+  nblocks = fssize - nmeta;
 
-  sb.size = xint(FSSIZE);
+  sb.size = xint(fssize);
   sb.nblocks = xint(nblocks);
   sb.ninodes = xint(NINODES);
   sb.nlog = xint(nlog);
   sb.logstart = xint(2);
   sb.inodestart = xint(2+nlog);
   sb.bmapstart = xint(2+nlog+ninodeblocks);
+  sb.bsize = xint(BSIZE);
+  sb.logtrans = xint(logtrans);
+  sb.opblocks = xint(MAXOPBLOCKS);
+  sb.ordered = xint(ordered);
 
   printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
-         nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
+         nmeta, nlog, ninodeblocks, nbitmap, nblocks, fssize);
 
   freeblock = nmeta;     // the first free block that we can allocate
 
-  for(i = 0; i < FSSIZE; i++)
+  for(i = 0; i < fssize; i++)
     wsect(i, zeroes);
 
   memset(buf, 0, sizeof(buf));
@@ -127,6 +151,21 @@ main(int argc, char *argv[])
   strcpy(de.name, "..");
   iappend(rootino, &de, sizeof(de));
 
+  // Directory the kernel mounts its tmpfs on.
+  inum = ialloc(T_DIR);
+  bzero(&de, sizeof(de));
+  de.inum = xshort(inum);
+  strcpy(de.name, "tmp");
+  iappend(rootino, &de, sizeof(de));
+  bzero(&de, sizeof(de));
+  de.inum = xshort(inum);
+  strcpy(de.name, ".");
+  iappend(inum, &de, sizeof(de));
+  bzero(&de, sizeof(de));
+  de.inum = xshort(rootino);
+  strcpy(de.name, "..");
+  iappend(inum, &de, sizeof(de));
+
   for(i = 2; i < argc; i++){
     assert(index(argv[i], '/') == 0);
 
@@ -260,7 +299,7 @@ iappend(uint inum, void *xp, int n)
   struct dinode din;
   char buf[BSIZE];
   uint indirect[NINDIRECT];
-  uint x;
+  uint x, ind, bn;
 
   rinode(inum, &din);
   off = xint(din.size);
@@ -273,6 +312,23 @@ iappend(uint inum, void *xp, int n)
         din.addrs[fbn] = xint(freeblock++);
       }
       x = xint(din.addrs[fbn]);
+    } else if(fbn >= NDIRECT + NINDIRECT){
+      bn = fbn - NDIRECT - NINDIRECT;
+      if(xint(din.addrs[NDIRECT+1]) == 0){
+        din.addrs[NDIRECT+1] = xint(freeblock++);
+      }
+      rsect(xint(din.addrs[NDIRECT+1]), (char*)indirect);
+      if(indirect[bn / NINDIRECT] == 0){
+        indirect[bn / NINDIRECT] = xint(freeblock++);
+        wsect(xint(din.addrs[NDIRECT+1]), (char*)indirect);
+      }
+      ind = xint(indirect[bn / NINDIRECT]);
+      rsect(ind, (char*)indirect);
+      if(indirect[bn % NINDIRECT] == 0){
+        indirect[bn % NINDIRECT] = xint(freeblock++);
+        wsect(ind, (char*)indirect);
+      }
+      x = xint(indirect[bn % NINDIRECT]);
     } else {
       if(xint(din.addrs[NDIRECT]) == 0){
         din.addrs[NDIRECT] = xint(freeblock++);
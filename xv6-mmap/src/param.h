@@ -1,14 +1,31 @@
-#define NPROC        64  // maximum number of processes
+#define NPROC      4096  // maximum number of processes
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
+#define MIGRATECOST   2  // ticks a process stays cache-hot on its last CPU
+#define NRQHIST       8  // buckets in run-queue latency histograms
+#define RQHISTSHIFT  12  // bucket i counts waits < 2^(RQHISTSHIFT+2*i) cycles
+#define NLOCKCLASS   64  // distinct lock names counted by lockstat
+#define SLEEPSPIN  2000  // pause loops a sleeplock waiter spins on a running owner
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
 #define NINODE       50  // maximum number of active i-nodes
+#define NDENTRY     128  // size of directory entry cache
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
+#define TMPDEV        2  // device number of the in-memory tmpfs
+#define NTMPINODE   200  // maximum number of tmpfs i-nodes
+#define NMOUNT        4  // maximum number of mounted file systems
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define LOGSIZE      256  // max data blocks in a log transaction
+#define NBUF         (MAXOPBLOCKS*3)  // initial size of disk block cache
+#define RAMIN           4  // initial sequential read-ahead window, in blocks
+#define RAMAX          32  // largest read-ahead window
+#define NBUFMAX      8192  // buffers the disk block cache may grow to
+#define BCACHELOWAT  1024  // free pages below which the cache stops growing
+#define IDEDEADLINE  10  // ticks a disk request waits before jumping the elevator
+#define LOGFLUSH    100  // ticks a logged update may wait to be committed
+#define LOGBATCH     10  // log blocks handed to the disk at once
+#define FSSIZE        8192  // size of file system in blocks
+#define MEMFSSIZE     500  // size of the one kernelmemfs embeds
 
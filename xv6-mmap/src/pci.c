@@ -0,0 +1,78 @@
+// PCI configuration space, through I/O ports 0xCF8/0xCFC.
+// Only bus 0 is scanned, which is where QEMU puts its devices.
+// A function is named by its address in configuration space:
+// bus<<16 | device<<11 | function<<8.
+// http://wiki.osdev.org/PCI
+
+#include "types.h"
+#include "defs.h"
+#include "x86.h"
+
+#define PCI_ADDR   0xCF8
+#define PCI_DATA   0xCFC
+
+#define PCI_ID     0x00  // device<<16 | vendor
+#define PCI_CLASS  0x08  // class<<24 | subclass<<16 | ...
+#define PCI_BAR0   0x10
+
+// Read the 32-bit register at offset off of function f.
+uint
+pciconfread(int f, int off)
+{
+  outl(PCI_ADDR, 0x80000000 | f | (off & 0xfc));
+  return inl(PCI_DATA);
+}
+
+void
+pciconfwrite(int f, int off, uint v)
+{
+  outl(PCI_ADDR, 0x80000000 | f | (off & 0xfc));
+  outl(PCI_DATA, v);
+}
+
+// Return the first function with the given vendor and
+// device ids, or -1.
+int
+pcifind(int vendor, int device)
+{
+  int f;
+  uint id;
+
+  for(f = 0; f < (32<<11); f += 1<<8){
+    id = pciconfread(f, PCI_ID);
+    if((id & 0xffff) == vendor && (id >> 16) == device)
+      return f;
+  }
+  return -1;
+}
+
+// Return the first function with the given class and
+// subclass, or -1.
+int
+pcifindclass(int class, int subclass)
+{
+  int f;
+  uint c;
+
+  for(f = 0; f < (32<<11); f += 1<<8){
+    if((pciconfread(f, PCI_ID) & 0xffff) == 0xffff)
+      continue;
+    c = pciconfread(f, PCI_CLASS);
+    if((c >> 24) == class && ((c >> 16) & 0xff) == subclass)
+      return f;
+  }
+  return -1;
+}
+
+// Return the I/O port base of base address register bar,
+// or 0 if it does not map I/O space.
+uint
+pciiobar(int f, int bar)
+{
+  uint v;
+
+  v = pciconfread(f, PCI_BAR0 + 4*bar);
+  if((v & 1) == 0)
+    return 0;
+  return v & ~3;
+}
@@ -0,0 +1,35 @@
+// Per-CPU variables.
+//
+// DEFINE_PERCPU(type, name) places name in the .data.percpu
+// section, which is only a template: percpuinit() gives every
+// cpu its own copy, and seginit() points that cpu's %gs at the
+// copy's offset from the template.  So percpu_read(name) and
+// friends compile to one %gs-relative instruction that touches
+// only this cpu's copy, with no lock, atomic or shared cache
+// line.  A single instruction cannot be interrupted halfway, so
+// percpu_add() is safe even with interrupts enabled, though the
+// process may move to another cpu right after it.
+//
+// The accessors work on word-sized variables.  For anything
+// larger, use percpu_ptr(name, c), which returns the address of
+// cpu c's copy, with interrupts off when c is this cpu.
+// Referring to name directly gives the template.
+
+#define DEFINE_PERCPU(type, name) \
+  __attribute__((section(".data.percpu"))) type name
+
+#define percpu_read(var) ({                                 \
+  typeof(var) __v;                                          \
+  asm volatile("movl %%gs:%1, %0" : "=r" (__v) : "m" (var)); \
+  __v; })
+
+#define percpu_write(var, val) \
+  asm volatile("movl %1, %%gs:%0" : "=m" (var) : "ri" ((uint)(val)))
+
+#define percpu_add(var, n) \
+  asm volatile("addl %1, %%gs:%0" : "+m" (var) : "ri" ((uint)(n)))
+
+#define percpu_inc(var) percpu_add(var, 1)
+
+#define percpu_ptr(var, c) \
+  ((typeof(&(var)))((char*)&(var) + (c)->percpuoff))
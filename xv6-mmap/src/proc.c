@@ -6,11 +6,30 @@
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "sleeplock.h"
+#include "percpu.h"
+#include "procinfo.h"
 
+#define NPIDHASH   256  // buckets in pid hash
+#define NSLEEPHASH 256  // buckets in sleep channel hash
+
+#define PIDHASH(pid)    ((uint)(pid) % NPIDHASH)
+#define SLEEPHASH(chan) (((uint)(chan) >> 2) % NSLEEPHASH)
+
+// Process descriptors are allocated with kmalloc() and
+// linked into a list of all processes, a pid hash for
+// kill(), and per-parent child lists for wait() and exit().
+// Sleeping processes are also queued on a hash of their
+// wait channel so wakeup() does not scan every process.
 struct {
   struct spinlock lock;
-  struct proc proc[NPROC];
-} ptable;
+  struct proc *list;                 // All processes
+  struct proc *pidhash[NPIDHASH];
+  struct proc *sleepq[NSLEEPHASH];
+  int nproc;
+} __attribute__((aligned(CACHELINE))) ptable;
+
+DEFINE_PERCPU(struct cpu*, thiscpu);
 
 static struct proc *initproc;
 
@@ -19,11 +38,27 @@ extern void forkret(void);
 extern void trapret(void);
 
 static void wakeup1(void *chan);
+static void makerunnable1(struct proc *p);
+static void shareuvm1(struct proc *curproc);
+static int detachuvm1(struct proc *p);
+
+// Locks serializing growth of an address space, found by
+// hashing its page directory, so threads sharing one page
+// table share its lock.  allocuvm and deallocuvm run under
+// it rather than under ptable.lock, which every CPU's
+// scheduler needs.
+#define NVMLOCK 16
+static struct sleeplock vmlock[NVMLOCK];
+#define VMLOCK(pgdir) (&vmlock[((uint)(pgdir) >> PTXSHIFT) % NVMLOCK])
 
 void
 pinit(void)
 {
+  int i;
+
   initlock(&ptable.lock, "ptable");
+  for(i = 0; i < NVMLOCK; i++)
+    initsleeplock(&vmlock[i], "vm");
 }
 
 // Must be called with interrupts disabled
@@ -33,15 +68,24 @@ cpuid() {
 }
 
 // Must be called with interrupts disabled to avoid the caller being
-// rescheduled between reading lapicid and running through the loop.
+// rescheduled to another cpu while it uses the result.
 struct cpu*
 mycpu(void)
 {
-  int apicid, i;
-  
   if(readeflags()&FL_IF)
     panic("mycpu called with interrupts enabled\n");
-  
+  return percpu_read(thiscpu);
+}
+
+// Find this cpu's struct cpu from its local APIC id.
+// Only seginit() needs this, before %gs is set up for mycpu().
+// Must be called with interrupts disabled to avoid the caller being
+// rescheduled between reading lapicid and running through the loop.
+struct cpu*
+lapiccpu(void)
+{
+  int apicid, i;
+
   apicid = lapicid();
   // APIC IDs are not guaranteed to be contiguous. Maybe we should have
   // a reverse map, or reserve a register to store &cpus[i].
@@ -66,36 +110,52 @@ myproc(void) {
 }
 
 //PAGEBREAK: 32
-// Look in the process table for an UNUSED proc.
-// If found, change state to EMBRYO and initialize
-// state required to run in the kernel.
+// Allocate a new proc and enter it in the process table.
+// If successful, its state is EMBRYO and the state
+// required to run in the kernel is initialized.
 // Otherwise return 0.
 static struct proc*
 allocproc(void)
 {
   struct proc *p;
+  struct proc **h;
   char *sp;
 
-  acquire(&ptable.lock);
+  if((p = kmalloc(sizeof(*p))) == 0)
+    return 0;
+  memset(p, 0, sizeof(*p));
+  p->lastcpu = -1;
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == UNUSED)
-      goto found;
+  // Allocate kernel stack.
+  if((p->kstack = kalloc()) == 0){
+    kmfree(p);
+    return 0;
+  }
 
-  release(&ptable.lock);
-  return 0;
+  acquire(&ptable.lock);
+
+  if(ptable.nproc >= NPROC){
+    release(&ptable.lock);
+    kfree(p->kstack);
+    kmfree(p);
+    return 0;
+  }
+  ptable.nproc++;
 
-found:
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->tnext = p;
+
+  p->next = ptable.list;
+  if(ptable.list)
+    ptable.list->prev = p;
+  ptable.list = p;
+  h = &ptable.pidhash[PIDHASH(p->pid)];
+  p->hnext = *h;
+  *h = p;
 
   release(&ptable.lock);
 
-  // Allocate kernel stack.
-  if((p->kstack = kalloc()) == 0){
-    p->state = UNUSED;
-    return 0;
-  }
   sp = p->kstack + KSTACKSIZE;
 
   // Leave room for trap frame.
@@ -115,6 +175,49 @@ found:
   return p;
 }
 
+// Remove p from the process table and free it.
+// p must not be on a child list or sleep queue.
+// The ptable lock must be held.
+static void
+freeproc1(struct proc *p)
+{
+  struct proc **pp;
+
+  for(pp = &ptable.pidhash[PIDHASH(p->pid)]; *pp != p; pp = &(*pp)->hnext)
+    ;
+  *pp = p->hnext;
+  if(p->prev)
+    p->prev->next = p->next;
+  else
+    ptable.list = p->next;
+  if(p->next)
+    p->next->prev = p->prev;
+  ptable.nproc--;
+
+  if(p->kstack)
+    kfree(p->kstack);
+  kmfree(p);
+}
+
+// Free a proc that allocproc() returned but that never ran.
+static void
+unallocproc(struct proc *p)
+{
+  acquire(&ptable.lock);
+  freeproc1(p);
+  release(&ptable.lock);
+}
+
+// Make np a child of parent.
+// The ptable lock must be held.
+static void
+adopt1(struct proc *parent, struct proc *np)
+{
+  np->parent = parent;
+  np->sibling = parent->children;
+  parent->children = np;
+}
+
 //PAGEBREAK: 32
 // Set up first user process.
 void
@@ -148,20 +251,73 @@ userinit(void)
   // because the assignment might not be atomic.
   acquire(&ptable.lock);
 
-  p->state = RUNNABLE;
+  p->affinity = ~0;
+  makerunnable1(p);
 
   release(&ptable.lock);
 }
 
+// A kernel thread's first scheduling by scheduler()
+// will swtch here.  Run its body, which never returns.
+static void
+kthreadret(void)
+{
+  // Still holding ptable.lock from scheduler.
+  release(&ptable.lock);
+  myproc()->kfn();
+  panic("kthread returned");
+}
+
+// Start a kernel thread running fn.  It runs only in the
+// kernel, on the kernel page table, and never exits.
+// Returns its pid, or -1.
+int
+kthread(void (*fn)(void), char *name)
+{
+  struct proc *p;
+  extern pde_t *kpgdir;
+
+  if((p = allocproc()) == 0)
+    return -1;
+  p->pgdir = kpgdir;
+  p->kfn = fn;
+  p->context->eip = (uint)kthreadret;
+  safestrcpy(p->name, name, sizeof(p->name));
+
+  acquire(&ptable.lock);
+  p->affinity = ~0;
+  makerunnable1(p);
+  release(&ptable.lock);
+
+  return p->pid;
+}
+
+// Lock p's address space against changes by the threads
+// sharing its page table: growth, the mmap region list,
+// and copying it in fork().
+void
+lockvm(struct proc *p)
+{
+  acquiresleep(VMLOCK(p->pgdir));
+}
+
+void
+unlockvm(struct proc *p)
+{
+  releasesleep(VMLOCK(p->pgdir));
+}
+
 // Grow current process's memory by n bytes.
-// Return 0 on success, -1 on failure.
+// Return the old size, which is where new memory starts,
+// or -1 on failure.  The caller must hold lockvm().
+// Threads sharing the page table see the new size too.
 int
-growproc(int n)
+growproc1(int n)
 {
-  uint sz;
+  uint oldsz, sz;
   struct proc *curproc = myproc();
 
-  sz = curproc->sz;
+  sz = oldsz = curproc->sz;
   if(n > 0){
     if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
       return -1;
@@ -169,11 +325,81 @@ growproc(int n)
     if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
       return -1;
   }
+  acquire(&ptable.lock);
   curproc->sz = sz;
+  shareuvm1(curproc);
+  release(&ptable.lock);
   switchuvm(curproc);
+  return oldsz;
+}
+
+int
+growproc(int n)
+{
+  int oldsz;
+  struct proc *curproc = myproc();
+
+  lockvm(curproc);
+  oldsz = growproc1(n);
+  unlockvm(curproc);
+  return oldsz;
+}
+
+// Copy curproc's view of its address space (size and
+// mmap regions) into every thread sharing its page table.
+// The ptable lock must be held.
+static void
+shareuvm1(struct proc *curproc)
+{
+  struct proc *p;
+
+  for(p = curproc->tnext; p != curproc; p = p->tnext){
+    p->sz = curproc->sz;
+    p->mmregion_head = curproc->mmregion_head;
+  }
+}
+
+void
+shareuvm(struct proc *curproc)
+{
+  acquire(&ptable.lock);
+  shareuvm1(curproc);
+  release(&ptable.lock);
+}
+
+// Remove p from the ring of threads sharing its page table.
+// Return 1 if p was the last one using it; zombie threads
+// count until they are reaped.
+// The ptable lock must be held.
+static int
+detachuvm1(struct proc *p)
+{
+  struct proc *q;
+
+  if(p->tnext == p)
+    return 1;
+  for(q = p->tnext; q->tnext != p; q = q->tnext)
+    ;
+  q->tnext = p->tnext;
+  p->tnext = p;
   return 0;
 }
 
+// Stop sharing curproc's page table with its threads,
+// as exec() does before installing a new image.
+// Return 1 if no thread is left using the old one,
+// in which case the caller should free it.
+int
+detachuvm(struct proc *curproc)
+{
+  int last;
+
+  acquire(&ptable.lock);
+  last = detachuvm1(curproc);
+  release(&ptable.lock);
+  return last;
+}
+
 // Create a new process copying p as the parent.
 // Sets up stack to return as if from system call.
 // Caller must set state of returned proc to RUNNABLE.
@@ -190,14 +416,16 @@ fork(void)
   }
 
   // Copy process state from proc.
+  // Hold the vm lock so that a sibling thread cannot shrink
+  // the address space out from under the copy.
+  lockvm(curproc);
   if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
-    kfree(np->kstack);
-    np->kstack = 0;
-    np->state = UNUSED;
+    unlockvm(curproc);
+    unallocproc(np);
     return -1;
   }
   np->sz = curproc->sz;
-  np->parent = curproc;
+  unlockvm(curproc);
   *np->tf = *curproc->tf;
 
   // Clear %eax so that fork returns 0 in the child.
@@ -214,7 +442,71 @@ fork(void)
 
   acquire(&ptable.lock);
 
-  np->state = RUNNABLE;
+  adopt1(curproc, np);
+  np->affinity = curproc->affinity;
+  makerunnable1(np);
+
+  release(&ptable.lock);
+
+  return pid;
+}
+
+// Create a new thread running fcn(arg1, arg2) on the user
+// stack page at stack.  The thread shares the caller's page
+// table and mmap regions; open files are shared as in fork().
+// fcn must call exit() rather than return.
+int
+clone(void (*fcn)(void*, void*), void *arg1, void *arg2, void *stack)
+{
+  int i, pid;
+  uint sp, ustack[3];
+  struct proc *np;
+  struct proc *curproc = myproc();
+
+  if((uint)stack >= curproc->sz || (uint)stack + PGSIZE > curproc->sz)
+    return -1;
+
+  if((np = allocproc()) == 0)
+    return -1;
+
+  np->pgdir = curproc->pgdir;
+  np->ustack = stack;
+  *np->tf = *curproc->tf;
+
+  // Start at fcn with the two arguments and a fake
+  // return PC on the new stack.
+  ustack[0] = 0xffffffff;
+  ustack[1] = (uint)arg1;
+  ustack[2] = (uint)arg2;
+  sp = (uint)stack + PGSIZE - sizeof(ustack);
+  if(copyout(np->pgdir, sp, ustack, sizeof(ustack)) < 0){
+    unallocproc(np);
+    return -1;
+  }
+  np->tf->esp = sp;
+  np->tf->ebp = sp;
+  np->tf->eip = (uint)fcn;
+
+  for(i = 0; i < NOFILE; i++)
+    if(curproc->ofile[i])
+      np->ofile[i] = filedup(curproc->ofile[i]);
+  np->cwd = idup(curproc->cwd);
+
+  safestrcpy(np->name, curproc->name, sizeof(curproc->name));
+
+  pid = np->pid;
+
+  acquire(&ptable.lock);
+
+  // Join curproc's thread ring, picking up its current
+  // size and regions in case another thread just grew them.
+  np->sz = curproc->sz;
+  np->mmregion_head = curproc->mmregion_head;
+  np->tnext = curproc->tnext;
+  curproc->tnext = np;
+  adopt1(curproc, np);
+  np->affinity = curproc->affinity;
+  makerunnable1(np);
 
   release(&ptable.lock);
 
@@ -253,12 +545,18 @@ exit(void)
   wakeup1(curproc->parent);
 
   // Pass abandoned children to init.
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->parent == curproc){
+  if((p = curproc->children) != 0){
+    for(;;){
       p->parent = initproc;
       if(p->state == ZOMBIE)
         wakeup1(initproc);
+      if(p->sibling == 0)
+        break;
+      p = p->sibling;
     }
+    p->sibling = initproc->children;
+    initproc->children = curproc->children;
+    curproc->children = 0;
   }
 
   // Jump into the scheduler, never to return.
@@ -267,34 +565,45 @@ exit(void)
   panic("zombie exit");
 }
 
+// Free the zombie child *pp, unlinking it from its
+// parent's child list, and return its pid.
+// Its page table goes too unless a thread still uses it.
+// The ptable lock must be held.
+static int
+reap1(struct proc **pp)
+{
+  struct proc *p = *pp;
+  int pid;
+
+  pid = p->pid;
+  *pp = p->sibling;
+  if(detachuvm1(p))
+    freevm(p->pgdir);
+  freeproc1(p);
+  return pid;
+}
+
 // Wait for a child process to exit and return its pid.
 // Return -1 if this process has no children.
+// Threads created by clone() are collected by join() instead.
 int
 wait(void)
 {
-  struct proc *p;
+  struct proc *p, **pp;
   int havekids, pid;
   struct proc *curproc = myproc();
   
   acquire(&ptable.lock);
   for(;;){
-    // Scan through table looking for exited children.
+    // Scan through children looking for exited ones.
     havekids = 0;
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->parent != curproc)
+    for(pp = &curproc->children; (p = *pp) != 0; pp = &p->sibling){
+      if(p->pgdir == curproc->pgdir)
         continue;
       havekids = 1;
       if(p->state == ZOMBIE){
         // Found one.
-        pid = p->pid;
-        kfree(p->kstack);
-        p->kstack = 0;
-        freevm(p->pgdir);
-        p->pid = 0;
-        p->parent = 0;
-        p->name[0] = 0;
-        p->killed = 0;
-        p->state = UNUSED;
+        pid = reap1(pp);
         release(&ptable.lock);
         return pid;
       }
@@ -311,7 +620,162 @@ wait(void)
   }
 }
 
+// Wait for a child thread to exit and return its pid.
+// Store the user stack it was created with in *stack
+// so the caller can free it.
+// Return -1 if this process has no child threads.
+int
+join(void **stack)
+{
+  struct proc *p, **pp;
+  int havekids, pid;
+  struct proc *curproc = myproc();
+
+  acquire(&ptable.lock);
+  for(;;){
+    havekids = 0;
+    for(pp = &curproc->children; (p = *pp) != 0; pp = &p->sibling){
+      if(p->pgdir != curproc->pgdir)
+        continue;
+      havekids = 1;
+      if(p->state == ZOMBIE){
+        *stack = p->ustack;
+        pid = reap1(pp);
+        release(&ptable.lock);
+        return pid;
+      }
+    }
+
+    if(!havekids || curproc->killed){
+      release(&ptable.lock);
+      return -1;
+    }
+
+    sleep(curproc, &ptable.lock);  //DOC: wait-sleep
+  }
+}
+
 //PAGEBREAK: 42
+// Run queues.  Each CPU has a FIFO of RUNNABLE processes.
+// A process goes back on the queue of the CPU it last ran
+// on, whose cache is likely still warm, unless its affinity
+// forbids that CPU or another allowed CPU is much less loaded.
+// A CPU with an empty queue takes work from the others
+// (see steal1).  The ptable lock must be held throughout.
+
+// Choose the cpu whose run queue p should join.
+static struct cpu*
+pickcpu1(struct proc *p)
+{
+  struct cpu *c, *best;
+
+  best = 0;
+  for(c = cpus; c < cpus+ncpu; c++)
+    if((p->affinity & (1 << (c-cpus))) &&
+       (best == 0 || c->nrunnable < best->nrunnable))
+      best = c;
+  if(best == 0)
+    panic("pickcpu: no cpu allowed");
+  if(p->lastcpu >= 0 && p->lastcpu < ncpu &&
+     (p->affinity & (1 << p->lastcpu))){
+    c = &cpus[p->lastcpu];
+    if(c->nrunnable < best->nrunnable + 2)
+      return c;
+  }
+  return best;
+}
+
+static void
+enqueue1(struct cpu *c, struct proc *p)
+{
+  p->rqnext = 0;
+  if(c->runq == 0)
+    c->runq = p;
+  else
+    c->runqtail->rqnext = p;
+  c->runqtail = p;
+  c->nrunnable++;
+  p->rqcpu = c;
+  p->rqstamp = rdtsc();
+}
+
+// Remove p, which must be on c's run queue.
+static void
+dequeue1(struct cpu *c, struct proc *p)
+{
+  struct proc **pp, *prev;
+
+  prev = 0;
+  for(pp = &c->runq; *pp != p; pp = &(*pp)->rqnext)
+    prev = *pp;
+  *pp = p->rqnext;
+  if(c->runqtail == p)
+    c->runqtail = prev;
+  c->nrunnable--;
+}
+
+// Mark p RUNNABLE and queue it on a cpu.
+static void
+makerunnable1(struct proc *p)
+{
+  p->state = RUNNABLE;
+  enqueue1(pickcpu1(p), p);
+}
+
+// Find work for c, whose own queue is empty, on another
+// cpu's queue.  A process that has been off a cpu for
+// MIGRATECOST ticks has lost its cache state and is cheap
+// to move; a cache-hot one is taken only from a cpu that
+// has others waiting too.
+static struct proc*
+steal1(struct cpu *c)
+{
+  struct cpu *q, *victim;
+  struct proc *p, *best;
+  int cold, bestcold;
+  uint bit = 1 << (c-cpus);
+
+  victim = 0;
+  best = 0;
+  bestcold = 0;
+  for(q = cpus; q < cpus+ncpu; q++){
+    if(q == c)
+      continue;
+    for(p = q->runq; p; p = p->rqnext){
+      if((p->affinity & bit) == 0)
+        continue;
+      cold = ticks - p->lastrun >= MIGRATECOST;
+      if(!cold && q->nrunnable < 2)
+        continue;
+      if(best == 0 || cold > bestcold ||
+         (cold == bestcold && q->nrunnable > victim->nrunnable)){
+        best = p;
+        victim = q;
+        bestcold = cold;
+      }
+      if(cold)
+        break;
+    }
+  }
+  if(best)
+    dequeue1(victim, best);
+  return best;
+}
+
+// Charge p, just taken off a run queue, for its wait.
+static void
+rqacct1(struct proc *p)
+{
+  uint64 w;
+  int i;
+
+  w = rdtsc() - p->rqstamp;
+  p->rqwait += w;
+  for(i = 0; i < NRQHIST-1 && (w >> (RQHISTSHIFT + 2*i)) != 0; i++)
+    ;
+  p->rqhist[i]++;
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
@@ -330,11 +794,15 @@ scheduler(void)
     // Enable interrupts on this processor.
     sti();
 
-    // Loop over process table looking for process to run.
+    // Take the next process from this cpu's run queue,
+    // or from a busier cpu's if there is none.
     acquire(&ptable.lock);
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->state != RUNNABLE)
-        continue;
+    if((p = c->runq) != 0)
+      dequeue1(c, p);
+    else
+      p = steal1(c);
+    if(p){
+      rqacct1(p);
 
       // Switch to chosen process.  It is the process's job
       // to release ptable.lock and then reacquire it
@@ -342,12 +810,14 @@ scheduler(void)
       c->proc = p;
       switchuvm(p);
       p->state = RUNNING;
+      p->lastcpu = c-cpus;
 
       swtch(&(c->scheduler), p->context);
       switchkvm();
 
       // Process is done running for now.
       // It should have changed its p->state before coming back.
+      p->lastrun = ticks;
       c->proc = 0;
     }
     release(&ptable.lock);
@@ -355,6 +825,67 @@ scheduler(void)
   }
 }
 
+// Restrict process pid (0 for the caller) to the cpus
+// whose bits are set in mask.  A queued process moves to
+// an allowed cpu at once; a running one when it next
+// gives up its cpu.
+int
+setaffinity(int pid, uint mask)
+{
+  struct proc *p;
+  struct proc *curproc = myproc();
+
+  mask &= (1 << ncpu) - 1;
+  if(mask == 0)
+    return -1;
+  if(pid == 0)
+    pid = curproc->pid;
+
+  acquire(&ptable.lock);
+  for(p = ptable.pidhash[PIDHASH(pid)]; p; p = p->hnext)
+    if(p->pid == pid)
+      break;
+  if(p == 0 || p->state == ZOMBIE){
+    release(&ptable.lock);
+    return -1;
+  }
+  p->affinity = mask;
+  if(p->state == RUNNABLE && (mask & (1 << (p->rqcpu-cpus))) == 0){
+    dequeue1(p->rqcpu, p);
+    enqueue1(pickcpu1(p), p);
+  }
+  release(&ptable.lock);
+
+  // Leave this cpu now if it is no longer allowed.
+  if(p == curproc){
+    pushcli();
+    if((mask & (1 << cpuid())) == 0){
+      popcli();
+      yield();
+    } else
+      popcli();
+  }
+  return 0;
+}
+
+// Return the affinity mask of process pid (0 for the caller).
+int
+getaffinity(int pid)
+{
+  struct proc *p;
+  int mask;
+
+  if(pid == 0)
+    pid = myproc()->pid;
+  mask = -1;
+  acquire(&ptable.lock);
+  for(p = ptable.pidhash[PIDHASH(pid)]; p; p = p->hnext)
+    if(p->pid == pid && p->state != ZOMBIE)
+      mask = p->affinity & ((1 << ncpu) - 1);
+  release(&ptable.lock);
+  return mask;
+}
+
 // Enter scheduler.  Must hold only ptable.lock
 // and have changed proc->state. Saves and restores
 // intena because intena is a property of this
@@ -386,7 +917,8 @@ void
 yield(void)
 {
   acquire(&ptable.lock);  //DOC: yieldlock
-  myproc()->state = RUNNABLE;
+  myproc()->nivcsw++;
+  makerunnable1(myproc());
   sched();
   release(&ptable.lock);
 }
@@ -407,6 +939,7 @@ forkret(void)
     first = 0;
     iinit(ROOTDEV);
     initlog(ROOTDEV);
+    tmpinit();
   }
 
   // Return to "caller", actually trapret (see allocproc).
@@ -438,6 +971,9 @@ sleep(void *chan, struct spinlock *lk)
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  p->nvcsw++;
+  p->snext = ptable.sleepq[SLEEPHASH(chan)];
+  ptable.sleepq[SLEEPHASH(chan)] = p;
 
   sched();
 
@@ -457,11 +993,28 @@ sleep(void *chan, struct spinlock *lk)
 static void
 wakeup1(void *chan)
 {
-  struct proc *p;
+  struct proc *p, **pp;
+
+  pp = &ptable.sleepq[SLEEPHASH(chan)];
+  while((p = *pp) != 0){
+    if(p->chan == chan){
+      *pp = p->snext;
+      makerunnable1(p);
+    } else
+      pp = &p->snext;
+  }
+}
+
+// Take the sleeping process p off its sleep queue.
+// The ptable lock must be held.
+static void
+unsleep1(struct proc *p)
+{
+  struct proc **pp;
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == SLEEPING && p->chan == chan)
-      p->state = RUNNABLE;
+  for(pp = &ptable.sleepq[SLEEPHASH(p->chan)]; *pp != p; pp = &(*pp)->snext)
+    ;
+  *pp = p->snext;
 }
 
 // Wake up all processes sleeping on chan.
@@ -482,12 +1035,14 @@ kill(int pid)
   struct proc *p;
 
   acquire(&ptable.lock);
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+  for(p = ptable.pidhash[PIDHASH(pid)]; p; p = p->hnext){
     if(p->pid == pid){
       p->killed = 1;
       // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
-        p->state = RUNNABLE;
+      if(p->state == SLEEPING){
+        unsleep1(p);
+        makerunnable1(p);
+      }
       release(&ptable.lock);
       return 0;
     }
@@ -496,6 +1051,72 @@ kill(int pid)
   return -1;
 }
 
+// Futexes.  A futex is named by the kernel address of the
+// user word, so it identifies the physical memory and works
+// for any processes or threads that map the same page.
+// Return that address, or 0 if uaddr is not a valid
+// aligned user word of the current process.
+static uint*
+futexkey(uint *uaddr)
+{
+  struct proc *curproc = myproc();
+  char *page;
+  uint a = (uint)uaddr;
+
+  if(a % 4 != 0 || a >= curproc->sz || a + 4 > curproc->sz)
+    return 0;
+  if((page = uva2ka(curproc->pgdir, (char*)PGROUNDDOWN(a))) == 0)
+    return 0;
+  return (uint*)(page + (a - PGROUNDDOWN(a)));
+}
+
+// Sleep until futex_wake() on uaddr, as long as *uaddr
+// still holds val.  ptable.lock orders the check against
+// wakers, so a wake between the check and sleeping is
+// not lost.  Returns -1 at once if *uaddr != val.
+int
+futex_wait(uint *uaddr, uint val)
+{
+  uint *key;
+
+  if((key = futexkey(uaddr)) == 0)
+    return -1;
+  acquire(&ptable.lock);
+  if(*key != val || myproc()->killed){
+    release(&ptable.lock);
+    return -1;
+  }
+  sleep(key, &ptable.lock);
+  release(&ptable.lock);
+  return 0;
+}
+
+// Wake up to n processes waiting on uaddr.
+// Returns the number woken.
+int
+futex_wake(uint *uaddr, int n)
+{
+  struct proc *p, **pp;
+  uint *key;
+  int woken;
+
+  if((key = futexkey(uaddr)) == 0)
+    return -1;
+  woken = 0;
+  acquire(&ptable.lock);
+  pp = &ptable.sleepq[SLEEPHASH(key)];
+  while((p = *pp) != 0 && woken < n){
+    if(p->chan == key){
+      *pp = p->snext;
+      makerunnable1(p);
+      woken++;
+    } else
+      pp = &p->snext;
+  }
+  release(&ptable.lock);
+  return woken;
+}
+
 //PAGEBREAK: 36
 // Print a process listing to console.  For debugging.
 // Runs when user types ^P on console.
@@ -516,14 +1137,14 @@ procdump(void)
   char *state;
   uint pc[10];
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->state == UNUSED)
-      continue;
+  for(p = ptable.list; p; p = p->next){
     if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
       state = states[p->state];
     else
       state = "???";
-    cprintf("%d %s %s", p->pid, state, p->name);
+    cprintf("%d %s %s cpu %d user %d sys %d csw %d/%d",
+            p->pid, state, p->name, p->lastcpu, p->utime, p->stime,
+            p->nvcsw, p->nivcsw);
     if(p->state == SLEEPING){
       getcallerpcs((uint*)p->context->ebp+2, pc);
       for(i=0; i<10 && pc[i] != 0; i++)
@@ -532,3 +1153,49 @@ procdump(void)
     cprintf("\n");
   }
 }
+
+// Copy statistics for up to n processes into pi.
+// Return the number copied.
+int
+getprocinfo(struct procinfo *pi, int n)
+{
+  struct proc *p;
+  int i;
+
+  i = 0;
+  acquire(&ptable.lock);
+  for(p = ptable.list; p && i < n; p = p->next, i++){
+    pi[i].pid = p->pid;
+    pi[i].ppid = p->parent ? p->parent->pid : 0;
+    pi[i].state = p->state;
+    pi[i].cpu = p->lastcpu;
+    pi[i].affinity = p->affinity;
+    pi[i].utime = p->utime;
+    pi[i].stime = p->stime;
+    pi[i].nvcsw = p->nvcsw;
+    pi[i].nivcsw = p->nivcsw;
+    pi[i].rqwait = p->rqwait >> 10;
+    memmove(pi[i].rqhist, p->rqhist, sizeof(pi[i].rqhist));
+    safestrcpy(pi[i].name, p->name, sizeof(pi[i].name));
+  }
+  release(&ptable.lock);
+  return i;
+}
+
+// Copy statistics for up to n cpus into ci.
+// Return the number copied.
+int
+getcpuinfo(struct cpuinfo *ci, int n)
+{
+  int i;
+
+  acquire(&ptable.lock);
+  for(i = 0; i < ncpu && i < n; i++){
+    ci[i].apicid = cpus[i].apicid;
+    ci[i].busyticks = cpus[i].busyticks;
+    ci[i].idleticks = cpus[i].idleticks;
+    ci[i].nrunnable = cpus[i].nrunnable;
+  }
+  release(&ptable.lock);
+  return i;
+}
@@ -8,10 +8,21 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
-};
+
+  // Run queue, protected by ptable.lock.
+  struct proc *runq;           // RUNNABLE processes waiting for this cpu
+  struct proc *runqtail;
+  int nrunnable;               // Length of runq
+
+  uint busyticks;              // Timer ticks with a process running
+  uint idleticks;              // Timer ticks with none
+
+  uint percpuoff;              // %gs base: offset of this cpu's per-cpu data
+} __attribute__((aligned(CACHELINE)));  // no false sharing in cpus[]
 
 extern struct cpu cpus[NCPU];
 extern int ncpu;
+extern struct cpu *thiscpu;    // per-cpu (see percpu.h); use mycpu()
 
 //PAGEBREAK: 17
 // Saved registers for kernel context switches.
@@ -66,6 +77,34 @@ struct proc {
   // TODO: should I initialized somewhere?
   struct mmregion *mmregion_head;     // Linked list of memory map regions
   int colt;
+  void *ustack;                       // User stack passed to clone() (threads only)
+  void (*kfn)(void);                  // Body of a kernel thread, else 0
+  int nshared;                        // Sleeplocks it holds shared
+
+  // Process table links, protected by ptable.lock.
+  struct proc *next;                  // All processes
+  struct proc *prev;
+  struct proc *hnext;                 // Pid hash chain
+  struct proc *snext;                 // Sleep queue for chan
+  struct proc *children;              // First child
+  struct proc *sibling;               // Next child of parent
+  struct proc *tnext;                 // Ring of threads sharing pgdir
+
+  // Scheduling, protected by ptable.lock.
+  struct proc *rqnext;                // Next on cpu run queue
+  struct cpu *rqcpu;                  // Cpu whose run queue holds it
+  uint affinity;                      // Bit i set: may run on cpus[i]
+  int lastcpu;                        // Cpu it last ran on, or -1
+  uint lastrun;                       // ticks when it last stopped running
+
+  // Accounting, reported by getprocinfo().
+  uint utime;                         // Timer ticks in user mode
+  uint stime;                         // Timer ticks in the kernel
+  uint nvcsw;                         // Voluntary context switches
+  uint nivcsw;                        // Involuntary context switches
+  uint64 rqstamp;                     // rdtsc() when it joined a run queue
+  uint64 rqwait;                      // Total cycles spent on run queues
+  uint rqhist[NRQHIST];               // Run-queue waits by length
 };
 
 // Process memory is laid out contiguously, low addresses first:
@@ -0,0 +1,25 @@
+// Scheduler statistics returned by getprocinfo() and
+// getcpuinfo().  Both the kernel and user programs use
+// this header file; it needs param.h for NRQHIST.
+
+struct procinfo {
+  int pid;
+  int ppid;
+  int state;              // enum procstate in proc.h
+  int cpu;                // Cpu it last ran on, or -1
+  uint affinity;          // Cpus it may run on, one bit each
+  uint utime;             // Timer ticks spent in user mode
+  uint stime;             // Timer ticks spent in the kernel
+  uint nvcsw;             // Voluntary context switches (sleeps)
+  uint nivcsw;            // Involuntary ones (timer preemption)
+  uint rqwait;            // Total run-queue wait, in 1024-cycle units
+  uint rqhist[NRQHIST];   // Run-queue waits by length (see param.h)
+  char name[16];
+};
+
+struct cpuinfo {
+  int apicid;
+  uint busyticks;         // Timer ticks with a process running
+  uint idleticks;         // Timer ticks in the scheduler loop
+  int nrunnable;          // Processes waiting on its run queue
+};
@@ -9,6 +9,7 @@
 #include "proc.h"
 #include "spinlock.h"
 #include "sleeplock.h"
+#include "lockstat.h"
 
 void
 initsleeplock(struct sleeplock *lk, char *name)
@@ -16,18 +17,74 @@ initsleeplock(struct sleeplock *lk, char *name)
   initlock(&lk->lk, "sleep lock");
   lk->name = name;
   lk->locked = 0;
+  lk->readers = 0;
+  lk->wwait = 0;
   lk->pid = 0;
+  lk->owner = 0;
+  lk->ownercpu = 0;
+#ifdef LOCKSTAT
+  lk->class = lockclass(name, LOCKSLEEP);
+#endif
+}
+
+// Most sleeplocks are held briefly, and sleeping costs a trip
+// through ptable.lock and two context switches.  So while the
+// exclusive owner is still running on another cpu, spin for a
+// while in the hope that it releases the lock soon.
+// Called with lk->lk held; returns 1 if it spun, having dropped
+// and re-acquired lk->lk, so the caller must recheck the lock.
+// The owner is only compared with the cpu's current proc, never
+// dereferenced, so it may safely have exited meanwhile.
+static int
+spinsleep(struct sleeplock *lk)
+{
+  struct proc *owner;
+  struct cpu *c;
+  int i;
+
+  owner = lk->owner;
+  c = lk->ownercpu;
+  if(!lk->locked || owner == 0 || c->proc != owner)
+    return 0;
+  release(&lk->lk);
+  for(i = 0; i < SLEEPSPIN; i++){
+    if(*(volatile uint*)&lk->locked == 0 ||
+       *(struct proc* volatile*)&c->proc != owner)
+      break;
+    pause();
+  }
+  acquire(&lk->lk);
+  return 1;
 }
 
 void
 acquiresleep(struct sleeplock *lk)
 {
+  int spun = 0;
+#ifdef LOCKSTAT
+  uint64 start = 0;
+#endif
+
   acquire(&lk->lk);
-  while (lk->locked) {
+#ifdef LOCKSTAT
+  if(lk->locked || lk->readers)
+    start = rdtsc();
+#endif
+  lk->wwait++;
+  while (lk->locked || lk->readers) {
+    if(!spun++ && spinsleep(lk))
+      continue;
     sleep(lk, &lk->lk);
   }
+  lk->wwait--;
   lk->locked = 1;
   lk->pid = myproc()->pid;
+  lk->owner = myproc();
+  lk->ownercpu = mycpu();
+#ifdef LOCKSTAT
+  lk->tacquire = rdtsc();
+  lockacquired(lk->class, mycpu(), start != 0, lk->tacquire - start);
+#endif
   release(&lk->lk);
 }
 
@@ -35,12 +92,56 @@ void
 releasesleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
+#ifdef LOCKSTAT
+  lockreleased(lk->class, mycpu(), rdtsc() - lk->tacquire);
+#endif
   lk->locked = 0;
   lk->pid = 0;
+  lk->owner = 0;
   wakeup(lk);
   release(&lk->lk);
 }
 
+// Acquire the lock in shared mode, alongside other readers.
+// Hold times are only counted for exclusive holders.
+void
+acquiresleepshared(struct sleeplock *lk)
+{
+  int spun = 0;
+#ifdef LOCKSTAT
+  uint64 start = 0;
+#endif
+
+  acquire(&lk->lk);
+#ifdef LOCKSTAT
+  if(lk->locked || lk->wwait)
+    start = rdtsc();
+#endif
+  while (lk->locked || lk->wwait) {
+    if(!spun++ && spinsleep(lk))
+      continue;
+    sleep(lk, &lk->lk);
+  }
+  lk->readers++;
+  myproc()->nshared++;
+#ifdef LOCKSTAT
+  lockacquired(lk->class, mycpu(), start != 0, rdtsc() - start);
+#endif
+  release(&lk->lk);
+}
+
+void
+releasesleepshared(struct sleeplock *lk)
+{
+  acquire(&lk->lk);
+  if(lk->readers == 0 || myproc()->nshared == 0)
+    panic("releasesleepshared");
+  myproc()->nshared--;
+  if(--lk->readers == 0)
+    wakeup(lk);
+  release(&lk->lk);
+}
+
 int
 holdingsleep(struct sleeplock *lk)
 {
@@ -1,10 +1,21 @@
-// Long-term locks for processes
+// Long-term locks for processes.
+// Held either exclusively by one process (acquiresleep) or
+// shared by any number of readers (acquiresleepshared).
+// Waiting writers hold off new readers so they cannot starve.
 struct sleeplock {
-  uint locked;       // Is the lock held?
+  uint locked;       // Is the lock held exclusively?
+  uint readers;      // Number of shared holders
+  uint wwait;        // Processes waiting for exclusive access
   struct spinlock lk; // spinlock protecting this sleep lock
   
   // For debugging:
   char *name;        // Name of lock.
   int pid;           // Process holding lock
+  struct proc *owner; // Exclusive holder, for adaptive spinning
+  struct cpu *ownercpu; // Cpu owner held the lock on
+#ifdef LOCKSTAT
+  struct lockclass *class; // Contention counters, see lockprof.c
+  uint64 tacquire;         // rdtsc() when acquired
+#endif
 };
 
@@ -8,13 +8,19 @@
 #include "mmu.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "lockstat.h"
 
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
+  lk->next = 0;
+  lk->owner = 0;
   lk->locked = 0;
   lk->cpu = 0;
+#ifdef LOCKSTAT
+  lk->class = lockclass(name, LOCKSPIN);
+#endif
 }
 
 // Acquire the lock.
@@ -24,22 +30,43 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint ticket, ahead;
+#ifdef LOCKSTAT
+  uint64 start = 0;
+#endif
+
   pushcli(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // The xchg is atomic.
-  while(xchg(&lk->locked, 1) != 0)
-    ;
+  // The xadd is atomic, so every acquirer gets its own ticket.
+  ticket = xadd(&lk->next, 1);
+
+  // Only the releasing cpu writes owner, so waiters just read it.
+  // Back off in proportion to our place in line to keep the
+  // cache line quiet while earlier tickets are served.
+  while((ahead = ticket - lk->owner) != 0){
+#ifdef LOCKSTAT
+    if(start == 0)
+      start = rdtsc();
+#endif
+    while(ahead-- > 0)
+      pause();
+  }
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
   // references happen after the lock is acquired.
   __sync_synchronize();
+  lk->locked = 1;
 
   // Record info about lock acquisition for debugging.
   lk->cpu = mycpu();
   getcallerpcs(&lk, lk->pcs);
+#ifdef LOCKSTAT
+  lk->tacquire = rdtsc();
+  lockacquired(lk->class, lk->cpu, start != 0, lk->tacquire - start);
+#endif
 }
 
 // Release the lock.
@@ -49,8 +76,12 @@ release(struct spinlock *lk)
   if(!holding(lk))
     panic("release");
 
+#ifdef LOCKSTAT
+  lockreleased(lk->class, lk->cpu, rdtsc() - lk->tacquire);
+#endif
   lk->pcs[0] = 0;
   lk->cpu = 0;
+  lk->locked = 0;
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that all the stores in the critical
@@ -59,10 +90,11 @@ release(struct spinlock *lk)
   // stores; __sync_synchronize() tells them both not to.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code can't use a C assignment, since it might
-  // not be atomic. A real OS would use C atomics here.
-  asm volatile("movl $0, %0" : "+m" (lk->locked) : );
+  // Release the lock by serving the next ticket, equivalent to
+  // lk->owner++.  Only the holder writes owner, so no lock prefix
+  // is needed, but this code can't use a C assignment, since it
+  // might not be a single store. A real OS would use C atomics here.
+  asm volatile("incl %0" : "+m" (lk->owner) : );
 
   popcli();
 }
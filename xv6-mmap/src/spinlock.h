@@ -1,11 +1,20 @@
 // Mutual exclusion lock.
+// A ticket lock: acquire() takes the next ticket and
+// waits for owner to reach it, so waiters get the lock
+// in FIFO order.
 struct spinlock {
-  uint locked;       // Is the lock held?
+  uint next;           // Next ticket to hand out.
+  volatile uint owner; // Ticket allowed to hold the lock.
+  uint locked;         // Is the lock held?
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
   uint pcs[10];      // The call stack (an array of program counters)
                      // that locked the lock.
+#ifdef LOCKSTAT
+  struct lockclass *class; // Contention counters, see lockprof.c
+  uint64 tacquire;         // rdtsc() when acquired
+#endif
 };
 
@@ -107,6 +107,18 @@ extern int sys_kmalloc(void);
 extern int sys_kmfree(void);
 extern int sys_mmap(void);
 extern int sys_munmap(void);
+extern int sys_clone(void);
+extern int sys_join(void);
+extern int sys_futex_wait(void);
+extern int sys_futex_wake(void);
+extern int sys_sched_setaffinity(void);
+extern int sys_sched_getaffinity(void);
+extern int sys_getprocinfo(void);
+extern int sys_getcpuinfo(void);
+extern int sys_lockstat(void);
+extern int sys_bcachestat(void);
+extern int sys_sync(void);
+extern int sys_fsync(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -134,6 +146,18 @@ static int (*syscalls[])(void) = {
 [SYS_kmfree]  sys_kmfree,
 [SYS_mmap]    sys_mmap,
 [SYS_munmap]  sys_munmap,
+[SYS_clone]   sys_clone,
+[SYS_join]    sys_join,
+[SYS_futex_wait] sys_futex_wait,
+[SYS_futex_wake] sys_futex_wake,
+[SYS_sched_setaffinity] sys_sched_setaffinity,
+[SYS_sched_getaffinity] sys_sched_getaffinity,
+[SYS_getprocinfo] sys_getprocinfo,
+[SYS_getcpuinfo] sys_getcpuinfo,
+[SYS_lockstat] sys_lockstat,
+[SYS_bcachestat] sys_bcachestat,
+[SYS_sync]    sys_sync,
+[SYS_fsync]   sys_fsync,
 };
 
 void
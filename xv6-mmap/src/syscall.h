@@ -24,3 +24,15 @@
 #define SYS_kmfree  23
 #define SYS_mmap    24
 #define SYS_munmap  25
+#define SYS_clone   26
+#define SYS_join    27
+#define SYS_futex_wait 28
+#define SYS_futex_wake 29
+#define SYS_sched_setaffinity 30
+#define SYS_sched_getaffinity 31
+#define SYS_getprocinfo 32
+#define SYS_getcpuinfo 33
+#define SYS_lockstat 34
+#define SYS_bcachestat 35
+#define SYS_sync   36
+#define SYS_fsync  37
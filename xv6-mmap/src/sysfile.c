@@ -15,6 +15,7 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "bcacheinfo.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -210,7 +211,7 @@ sys_unlink(void)
 
   if(ip->nlink < 1)
     panic("unlink: nlink < 1");
-  if(ip->type == T_DIR && !isdirempty(ip)){
+  if(ip->type == T_DIR && (!isdirempty(ip) || ismountpoint(ip))){
     iunlockput(ip);
     goto bad;
   }
@@ -218,7 +219,9 @@ sys_unlink(void)
   memset(&de, 0, sizeof(de));
   if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
     panic("unlink: writei");
+  dcacheinval(dp, name);
   if(ip->type == T_DIR){
+    dcachepurge(ip);
     dp->nlink--;
     iupdate(dp);
   }
@@ -307,7 +310,7 @@ sys_open(void)
       end_op();
       return -1;
     }
-    ilock(ip);
+    ilockshared(ip);
     if(ip->type == T_DIR && omode != O_RDONLY){
       iunlockput(ip);
       end_op();
@@ -328,6 +331,7 @@ sys_open(void)
   f->type = FD_INODE;
   f->ip = ip;
   f->off = 0;
+  memset(&f->ra, 0, sizeof(f->ra));
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
   return fd;
@@ -443,3 +447,35 @@ sys_pipe(void)
   fd[1] = fd1;
   return 0;
 }
+
+int
+sys_bcachestat(void)
+{
+  struct bcacheinfo *bi;
+
+  if(argptr(0, (void*)&bi, sizeof(*bi)) < 0)
+    return -1;
+  bcachestat(bi);
+  return 0;
+}
+
+// Make the updates of finished system calls durable.
+int
+sys_sync(void)
+{
+  log_sync();
+  return 0;
+}
+
+// The log commits all files' updates together, so
+// fsync() is sync() on a file descriptor.
+int
+sys_fsync(void)
+{
+  struct file *f;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  log_sync();
+  return 0;
+}
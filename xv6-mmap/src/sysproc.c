@@ -6,6 +6,8 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "procinfo.h"
+#include "lockstat.h"
 
 int
 sys_fork(void)
@@ -50,8 +52,7 @@ sys_sbrk(void)
 
   if(argint(0, &n) < 0)
     return -1;
-  addr = myproc()->sz;
-  if(growproc(n) < 0)
+  if((addr = growproc(n)) < 0)
     return -1;
   return addr;
 }
@@ -144,3 +145,101 @@ sys_munmap(void)
     return -1;
   return (int)munmap((void*)addr, (uint)length);
 }
+
+int
+sys_clone(void)
+{
+  int fcn, arg1, arg2, stack;
+
+  if(argint(0, &fcn) < 0 || argint(1, &arg1) < 0 ||
+     argint(2, &arg2) < 0 || argint(3, &stack) < 0)
+    return -1;
+  return clone((void(*)(void*, void*))fcn, (void*)arg1, (void*)arg2,
+               (void*)stack);
+}
+
+int
+sys_futex_wait(void)
+{
+  int addr, val;
+
+  if(argint(0, &addr) < 0 || argint(1, &val) < 0)
+    return -1;
+  return futex_wait((uint*)addr, (uint)val);
+}
+
+int
+sys_futex_wake(void)
+{
+  int addr, n;
+
+  if(argint(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return futex_wake((uint*)addr, n);
+}
+
+int
+sys_sched_setaffinity(void)
+{
+  int pid, mask;
+
+  if(argint(0, &pid) < 0 || argint(1, &mask) < 0)
+    return -1;
+  return setaffinity(pid, (uint)mask);
+}
+
+int
+sys_sched_getaffinity(void)
+{
+  int pid;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  return getaffinity(pid);
+}
+
+int
+sys_getprocinfo(void)
+{
+  struct procinfo *pi;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0 || n > NPROC ||
+     argptr(0, (void*)&pi, n*sizeof(*pi)) < 0)
+    return -1;
+  return getprocinfo(pi, n);
+}
+
+int
+sys_getcpuinfo(void)
+{
+  struct cpuinfo *ci;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0 || n > NCPU ||
+     argptr(0, (void*)&ci, n*sizeof(*ci)) < 0)
+    return -1;
+  return getcpuinfo(ci, n);
+}
+
+int
+sys_lockstat(void)
+{
+  struct lockinfo *li;
+  int n, reset;
+
+  if(argint(1, &n) < 0 || n < 0 || n > NLOCKCLASS ||
+     argptr(0, (void*)&li, n*sizeof(*li)) < 0 || argint(2, &reset) < 0)
+    return -1;
+  return lockstat(li, n, reset);
+}
+
+int
+sys_join(void)
+{
+  void **stack;
+
+  if(argptr(0, (void*)&stack, sizeof(*stack)) < 0)
+    return -1;
+  return join(stack);
+}
@@ -0,0 +1,186 @@
+// In-memory file system, mounted on /tmp.
+//
+// fs.c calls in here for inodes with ip->dev == TMPDEV.
+// Their on-"disk" state lives in a fixed table of tinodes,
+// and their data in pages from kalloc(), found through a
+// page of page pointers.  Nothing is logged or written to
+// disk, and everything is lost at reboot.
+//
+// The inode's sleeplock protects its tinode and data, as
+// with the disk file system; tmpfs.lock only guards the
+// allocation of tinodes.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "stat.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+
+#define TMPNPAGE  (PGSIZE/sizeof(char*))  // largest file, in pages
+
+struct tinode {
+  short type;           // 0 if free
+  short major;
+  short minor;
+  short nlink;
+  uint size;
+  char **pages;         // TMPNPAGE data page pointers, or 0
+};
+
+static struct {
+  struct spinlock lock;
+  struct tinode inode[NTMPINODE];
+} tmpfs;
+
+// Set up an empty root directory and mount it on /tmp.
+// Must be called in process context, after initlog().
+void
+tmpinit(void)
+{
+  struct tinode *t;
+  struct dirent *de;
+
+  initlock(&tmpfs.lock, "tmpfs");
+
+  // The root's ".." is itself; namex() steps out of the
+  // mount instead of following it.
+  t = &tmpfs.inode[ROOTINO];
+  t->type = T_DIR;
+  t->nlink = 1;
+  if((t->pages = (char**)kalloc()) == 0)
+    panic("tmpinit");
+  memset(t->pages, 0, PGSIZE);
+  if((t->pages[0] = kalloc()) == 0)
+    panic("tmpinit");
+  memset(t->pages[0], 0, PGSIZE);
+  de = (struct dirent*)t->pages[0];
+  de[0].inum = ROOTINO;
+  safestrcpy(de[0].name, ".", DIRSIZ);
+  de[1].inum = ROOTINO;
+  safestrcpy(de[1].name, "..", DIRSIZ);
+  t->size = 2*sizeof(*de);
+
+  mount("/tmp", TMPDEV);
+}
+
+// Allocate a tinode of type type and return its number.
+uint
+tmpialloc(short type)
+{
+  uint inum;
+
+  acquire(&tmpfs.lock);
+  for(inum = 1; inum < NTMPINODE; inum++){
+    if(tmpfs.inode[inum].type == 0){
+      memset(&tmpfs.inode[inum], 0, sizeof(struct tinode));
+      tmpfs.inode[inum].type = type;
+      release(&tmpfs.lock);
+      return inum;
+    }
+  }
+  panic("tmpialloc: no inodes");
+}
+
+// Fill in ip from its tinode, as ilock() does from disk.
+void
+tmpiload(struct inode *ip)
+{
+  struct tinode *t = &tmpfs.inode[ip->inum];
+
+  ip->type = t->type;
+  ip->major = t->major;
+  ip->minor = t->minor;
+  ip->nlink = t->nlink;
+  ip->size = t->size;
+}
+
+// Copy ip back to its tinode, which is freed if ip->type
+// is 0.  Caller must hold ip->lock.
+void
+tmpiupdate(struct inode *ip)
+{
+  struct tinode *t = &tmpfs.inode[ip->inum];
+
+  acquire(&tmpfs.lock);
+  t->type = ip->type;
+  t->major = ip->major;
+  t->minor = ip->minor;
+  t->nlink = ip->nlink;
+  t->size = ip->size;
+  release(&tmpfs.lock);
+}
+
+// Free ip's data.  Caller must hold ip->lock.
+void
+tmpitrunc(struct inode *ip)
+{
+  struct tinode *t = &tmpfs.inode[ip->inum];
+  int i;
+
+  if(t->pages == 0)
+    return;
+  for(i = 0; i < TMPNPAGE; i++)
+    if(t->pages[i])
+      kfree(t->pages[i]);
+  kfree((char*)t->pages);
+  t->pages = 0;
+}
+
+// Read n bytes at off, which readi() has checked lie
+// within the file.  Holes read as zeroes.
+int
+tmpreadi(struct inode *ip, char *dst, uint off, uint n)
+{
+  struct tinode *t = &tmpfs.inode[ip->inum];
+  uint tot, m;
+  char *pg;
+
+  for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    m = n - tot;
+    if(m > PGSIZE - off%PGSIZE)
+      m = PGSIZE - off%PGSIZE;
+    pg = t->pages ? t->pages[off/PGSIZE] : 0;
+    if(pg)
+      memmove(dst, pg + off%PGSIZE, m);
+    else
+      memset(dst, 0, m);
+  }
+  return n;
+}
+
+// Write n bytes at off, allocating pages as needed.
+// Returns n, or -1 if the file would be too big or
+// memory runs out.  writei() updates the size.
+int
+tmpwritei(struct inode *ip, char *src, uint off, uint n)
+{
+  struct tinode *t = &tmpfs.inode[ip->inum];
+  uint tot, m;
+  char **pp;
+
+  if(off + n > TMPNPAGE*PGSIZE)
+    return -1;
+  if(t->pages == 0){
+    if((t->pages = (char**)kalloc()) == 0)
+      return -1;
+    memset(t->pages, 0, PGSIZE);
+  }
+
+  for(tot=0; tot<n; tot+=m, off+=m, src+=m){
+    m = n - tot;
+    if(m > PGSIZE - off%PGSIZE)
+      m = PGSIZE - off%PGSIZE;
+    pp = &t->pages[off/PGSIZE];
+    if(*pp == 0){
+      if((*pp = kalloc()) == 0)
+        return -1;
+      memset(*pp, 0, PGSIZE);
+    }
+    memmove(*pp + off%PGSIZE, src, m);
+  }
+  return n;
+}
@@ -0,0 +1,120 @@
+// Show per-cpu utilization and per-process scheduler
+// statistics, sampled over an interval.
+// usage: top [interval-ticks [count]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "procinfo.h"
+#include "bcacheinfo.h"
+
+#define MAXINFO 256
+
+static char *states[] = {
+  "unused",
+  "embryo",
+  "sleep ",
+  "runble",
+  "run   ",
+  "zombie",
+};
+
+struct procinfo *before, *after;
+struct cpuinfo cbefore[NCPU], cafter[NCPU];
+
+// Print x right-aligned in a field of width w.
+void
+printpad(int x, int w)
+{
+  int n, y;
+
+  n = 1;
+  for(y = x; y >= 10; y /= 10)
+    n++;
+  for(; n < w; n++)
+    printf(1, " ");
+  printf(1, "%d", x);
+}
+
+struct procinfo*
+lookup(struct procinfo *pi, int n, int pid)
+{
+  int i;
+
+  for(i = 0; i < n; i++)
+    if(pi[i].pid == pid)
+      return &pi[i];
+  return 0;
+}
+
+void
+top(int interval)
+{
+  int i, nb, na, nc, busy, total;
+  struct procinfo *p, *q;
+  struct bcacheinfo bi;
+  uint ut, st;
+
+  nb = getprocinfo(before, MAXINFO);
+  getcpuinfo(cbefore, NCPU);
+  sleep(interval);
+  na = getprocinfo(after, MAXINFO);
+  nc = getcpuinfo(cafter, NCPU);
+
+  for(i = 0; i < nc; i++){
+    busy = cafter[i].busyticks - cbefore[i].busyticks;
+    total = busy + cafter[i].idleticks - cbefore[i].idleticks;
+    printf(1, "cpu%d:", i);
+    printpad(total ? busy*100/total : 0, 4);
+    printf(1, "%% busy, %d queued\n", cafter[i].nrunnable);
+  }
+  if(bcachestat(&bi) == 0)
+    printf(1, "bcache: %d/%d bufs, %d hits, %d misses\n",
+           bi.nbuf, bi.maxbuf, bi.hits, bi.misses);
+
+  printf(1, "  PID STATE  CPU USER  SYS  VCSW IVCSW RQWAITK NAME\n");
+  for(i = 0; i < na; i++){
+    p = &after[i];
+    ut = p->utime;
+    st = p->stime;
+    if((q = lookup(before, nb, p->pid)) != 0){
+      ut -= q->utime;
+      st -= q->stime;
+    }
+    printpad(p->pid, 5);
+    printf(1, " %s", p->state >= 0 && p->state < sizeof(states)/sizeof(states[0]) ?
+           states[p->state] : "???   ");
+    printpad(p->cpu, 4);
+    printpad(ut, 5);
+    printpad(st, 5);
+    printpad(p->nvcsw, 6);
+    printpad(p->nivcsw, 6);
+    printpad(p->rqwait, 8);
+    printf(1, " %s\n", p->name);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int interval, count;
+
+  interval = 100;
+  count = 1;
+  if(argc > 1)
+    interval = atoi(argv[1]);
+  if(argc > 2)
+    count = atoi(argv[2]);
+
+  before = malloc(MAXINFO * sizeof(struct procinfo));
+  after = malloc(MAXINFO * sizeof(struct procinfo));
+  if(before == 0 || after == 0){
+    printf(2, "top: out of memory\n");
+    exit();
+  }
+
+  while(count-- > 0)
+    top(interval);
+  exit();
+}
@@ -11,8 +11,10 @@
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
 extern uint vectors[];  // in vectors.S: array of 256 entry pointers
-struct spinlock tickslock;
-uint ticks;
+// ticks is written by cpu 0 and read everywhere; keep it
+// off the lines other cpus write.
+struct spinlock tickslock __attribute__((aligned(CACHELINE)));
+uint ticks __attribute__((aligned(CACHELINE)));
 
 void
 tvinit(void)
@@ -54,6 +56,15 @@ trap(struct trapframe *tf)
       wakeup(&ticks);
       release(&tickslock);
     }
+    // Charge the tick to whatever this cpu was doing.
+    if(myproc() && myproc()->state == RUNNING){
+      if((tf->cs&3) == DPL_USER)
+        myproc()->utime++;
+      else
+        myproc()->stime++;
+      mycpu()->busyticks++;
+    } else
+      mycpu()->idleticks++;
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE:
@@ -80,6 +91,11 @@ trap(struct trapframe *tf)
 
   //PAGEBREAK: 13
   default:
+    if(virtioirq != 0 && tf->trapno == T_IRQ0 + virtioirq){
+      virtiointr();
+      lapiceoi();
+      break;
+    }
     if(myproc() == 0 || (tf->cs&3) == 0){
       // In kernel, it must be our mistake.
       cprintf("unexpected trap %d from cpu %d eip %x (cr2=0x%x)\n",
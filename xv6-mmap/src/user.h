@@ -1,5 +1,21 @@
 struct stat;
 struct rtcdate;
+struct procinfo;
+struct cpuinfo;
+struct lockinfo;
+struct bcacheinfo;
+
+typedef struct {
+  volatile uint locked;
+} lock_t;
+
+typedef struct {
+  volatile uint state;  // 0 unlocked, 1 locked, 2 locked with waiters
+} mutex_t;
+
+typedef struct {
+  volatile uint seq;
+} cond_t;
 
 // system calls
 int fork(void);
@@ -27,6 +43,18 @@ void *kmalloc(uint nbytes);
 void kmfree(void *addr);
 void *mmap(void *addr, int length, int prot, int flags, int fd, int offset);
 int munmap(void *addr, int length);
+int clone(void(*fcn)(void*, void*), void *arg1, void *arg2, void *stack);
+int join(void **stack);
+int futex_wait(volatile uint *addr, uint val);
+int futex_wake(volatile uint *addr, int n);
+int sched_setaffinity(int pid, uint mask);
+int sched_getaffinity(int pid);
+int getprocinfo(struct procinfo*, int);
+int getcpuinfo(struct cpuinfo*, int);
+int lockstat(struct lockinfo*, int, int);
+int bcachestat(struct bcacheinfo*);
+int sync(void);
+int fsync(int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -41,3 +69,15 @@ void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+int thread_create(void(*)(void*, void*), void*, void*);
+int thread_join(void);
+void lock_init(lock_t*);
+void lock_acquire(lock_t*);
+void lock_release(lock_t*);
+void mutex_init(mutex_t*);
+void mutex_lock(mutex_t*);
+void mutex_unlock(mutex_t*);
+void cond_init(cond_t*);
+void cond_wait(cond_t*, mutex_t*);
+void cond_signal(cond_t*);
+void cond_broadcast(cond_t*);
@@ -0,0 +1,253 @@
+// Driver for a legacy virtio-blk PCI disk.  Unlike the IDE
+// disk it takes many requests at once: each one is a chain
+// of descriptors in the queue, and the device finishes them
+// in any order and reports them through the used ring.
+// ide.c hands disk 1 to this driver when QEMU provides it.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "virtio.h"
+
+#define VRINGMAX   256   // largest queue this driver can hold
+#define VIOMAXSEG   32   // most bufs in one request
+
+#define VRINGUP(sz)  (((sz)+VRING_ALIGN-1) & ~(VRING_ALIGN-1))
+
+// A request in flight, filed under its head descriptor.
+struct vreq {
+  struct virtio_blk_req hdr;
+  uchar status;          // the device writes 0 on success
+  int nb;
+  struct buf *b[VIOMAXSEG]; // for consecutive blocks
+};
+
+static struct {
+  struct spinlock lock;
+  uint base;             // I/O ports
+  uint nsect;            // disk size
+  int n;                 // descriptors in the queue
+  struct vring_desc *desc;
+  volatile struct vring_avail *avail;
+  volatile struct vring_used *used;
+  ushort usedidx;        // next used entry to look at
+  ushort freehd;         // free descriptors, chained by next
+  int nfree;
+  struct vreq req[VRINGMAX];
+} vio;
+
+// The queue must be physically contiguous, which kernel
+// data is and kalloc() pages are not.
+static char vring[VRINGUP(VRINGMAX*sizeof(struct vring_desc) + 6 + 2*VRINGMAX) +
+                  VRINGUP(6 + 8*VRINGMAX)] __attribute__((aligned(VRING_ALIGN)));
+
+int virtioirq;
+
+// Find and set up a virtio-blk disk.  Returns 0 if there
+// is one ready to use, -1 if not.
+int
+virtioinit(void)
+{
+  int f, i, n;
+  uint base;
+
+  if((f = pcifind(VIRTIO_VENDOR, VIRTIO_BLK_DEVICE)) < 0 ||
+     (base = pciiobar(f, 0)) == 0)
+    return -1;
+  pciconfwrite(f, 0x04, pciconfread(f, 0x04) | 0x5);
+
+  outb(base+VIRTIO_STATUS, 0);  // reset
+  outb(base+VIRTIO_STATUS, VIRTIO_ACK);
+  outb(base+VIRTIO_STATUS, VIRTIO_ACK|VIRTIO_DRIVER);
+  outl(base+VIRTIO_GFEATURES, 0);
+
+  outw(base+VIRTIO_QSEL, 0);
+  n = inw(base+VIRTIO_QSIZE);
+  if(n == 0 || n > VRINGMAX){
+    outb(base+VIRTIO_STATUS, VIRTIO_FAILED);
+    return -1;
+  }
+
+  initlock(&vio.lock, "virtio");
+  vio.base = base;
+  vio.nsect = inl(base+VIRTIO_BLK_CAPACITY);
+  if(inl(base+VIRTIO_BLK_CAPACITY+4) != 0)
+    vio.nsect = ~0;
+  vio.n = n;
+  memset(vring, 0, sizeof(vring));
+  vio.desc = (struct vring_desc*)vring;
+  vio.avail = (struct vring_avail*)(vring + n*sizeof(struct vring_desc));
+  vio.used = (struct vring_used*)(vring +
+    VRINGUP(n*sizeof(struct vring_desc) + 6 + 2*n));
+  for(i = 0; i < n; i++)
+    vio.desc[i].next = i+1;
+  vio.freehd = 0;
+  vio.nfree = n;
+  outl(base+VIRTIO_QADDR, V2P(vring) / VRING_ALIGN);
+
+  virtioirq = pciconfread(f, 0x3c) & 0xff;
+  ioapicenable(virtioirq, ncpu - 1);
+  outb(base+VIRTIO_STATUS, VIRTIO_ACK|VIRTIO_DRIVER|VIRTIO_DRIVER_OK);
+  return 0;
+}
+
+// Take a free descriptor.  Caller must hold vio.lock.
+static int
+vdescalloc(void)
+{
+  int d;
+
+  if(vio.nfree == 0)
+    panic("vdescalloc");
+  d = vio.freehd;
+  vio.freehd = vio.desc[d].next;
+  vio.nfree--;
+  return d;
+}
+
+// Caller must hold vio.lock.
+static void
+vdescfree(int d)
+{
+  vio.desc[d].next = vio.freehd;
+  vio.freehd = d;
+  vio.nfree++;
+}
+
+// Make the device look at new requests.
+static void
+vnotify(void)
+{
+  __sync_synchronize();
+  outw(vio.base+VIRTIO_QNOTIFY, 0);
+}
+
+// Put the locked bufs bs[0..n-1] on the queue and return
+// without waiting, like idesubmit().  Runs of consecutive
+// blocks going the same way become one request.
+void
+virtiosubmit(struct buf **bs, int n)
+{
+  struct vreq *r;
+  int i, j, nb, head, d, k, write;
+
+  acquire(&vio.lock);
+  for(i = 0; i < n; i += nb){
+    write = (bs[i]->flags & B_DIRTY) != 0;
+    for(nb = 1; i+nb < n && nb < VIOMAXSEG; nb++)
+      if(bs[i+nb]->blockno != bs[i+nb-1]->blockno + 1 ||
+         ((bs[i+nb]->flags & B_DIRTY) != 0) != write)
+        break;
+    if((bs[i+nb-1]->blockno + 1) * (BSIZE/512) > vio.nsect)
+      panic("virtiosubmit: block out of range");
+
+    if(vio.nfree < nb + 2){
+      // Let the device finish what is queued so far.
+      vnotify();
+      while(vio.nfree < nb + 2)
+        sleep(&vio.nfree, &vio.lock);
+    }
+
+    head = vdescalloc();
+    r = &vio.req[head];
+    r->hdr.type = write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+    r->hdr.reserved = 0;
+    r->hdr.sector = bs[i]->blockno * (BSIZE/512);
+    r->hdr.sectorhi = 0;
+    r->status = 0xff;
+    r->nb = nb;
+    vio.desc[head].addr = V2P(&r->hdr);
+    vio.desc[head].addrhi = 0;
+    vio.desc[head].len = sizeof(r->hdr);
+    vio.desc[head].flags = VRING_DESC_F_NEXT;
+
+    d = head;
+    for(j = 0; j < nb; j++){
+      r->b[j] = bs[i+j];
+      k = vdescalloc();
+      vio.desc[d].next = k;
+      d = k;
+      vio.desc[d].addr = V2P(bs[i+j]->data);
+      vio.desc[d].addrhi = 0;
+      vio.desc[d].len = BSIZE;
+      vio.desc[d].flags = VRING_DESC_F_NEXT | (write ? 0 : VRING_DESC_F_WRITE);
+    }
+
+    k = vdescalloc();
+    vio.desc[d].next = k;
+    d = k;
+    vio.desc[d].addr = V2P(&r->status);
+    vio.desc[d].addrhi = 0;
+    vio.desc[d].len = 1;
+    vio.desc[d].flags = VRING_DESC_F_WRITE;
+
+    vio.avail->ring[vio.avail->idx % vio.n] = head;
+    __sync_synchronize();
+    vio.avail->idx++;
+  }
+  vnotify();
+  release(&vio.lock);
+}
+
+// Wait for the transfer of b submitted by virtiosubmit().
+void
+virtioawait(struct buf *b)
+{
+  acquire(&vio.lock);
+  while((b->flags & (B_VALID|B_DIRTY)) != B_VALID)
+    sleep(b, &vio.lock);
+  release(&vio.lock);
+}
+
+// Interrupt handler.
+void
+virtiointr(void)
+{
+  struct vreq *r;
+  struct buf *b;
+  int d, f, j;
+
+  acquire(&vio.lock);
+  inb(vio.base+VIRTIO_ISR);  // ack
+
+  while(vio.usedidx != vio.used->idx){
+    __sync_synchronize();
+    d = vio.used->ring[vio.usedidx % vio.n].id;
+    r = &vio.req[d];
+    if(r->status != 0)
+      panic("virtiointr: request failed");
+
+    // Wake processes waiting for the bufs, and release
+    // buffers no one is waiting for.
+    for(j = 0; j < r->nb; j++){
+      b = r->b[j];
+      if(b->flags & B_ASYNC){
+        b->flags = (b->flags | B_VALID) & ~(B_DIRTY|B_ASYNC);
+        bdone(b);
+      } else {
+        b->flags |= B_VALID;
+        b->flags &= ~B_DIRTY;
+        wakeup(b);
+      }
+    }
+
+    do {
+      f = vio.desc[d].flags;
+      j = vio.desc[d].next;
+      vdescfree(d);
+      d = j;
+    } while(f & VRING_DESC_F_NEXT);
+    vio.usedidx++;
+  }
+  wakeup(&vio.nfree);
+
+  release(&vio.lock);
+}
@@ -0,0 +1,62 @@
+// Legacy virtio over PCI, as QEMU's virtio-blk-pci offers it.
+// http://docs.oasis-open.org/virtio/virtio/v1.0/virtio-v1.0.html
+// (section 4.1.4.8, "Legacy Interfaces").
+
+#define VIRTIO_VENDOR        0x1af4
+#define VIRTIO_BLK_DEVICE    0x1001  // transitional block device
+
+// Registers in I/O space at BAR0.
+#define VIRTIO_FEATURES      0x00  // device features
+#define VIRTIO_GFEATURES     0x04  // features the driver uses
+#define VIRTIO_QADDR         0x08  // physical page number of queue
+#define VIRTIO_QSIZE         0x0c  // 16 bits: entries in queue
+#define VIRTIO_QSEL          0x0e  // 16 bits: queue to configure
+#define VIRTIO_QNOTIFY       0x10  // 16 bits: queue has new requests
+#define VIRTIO_STATUS        0x12  //  8 bits: device status
+#define VIRTIO_ISR           0x13  //  8 bits: interrupt cause; reading acks
+#define VIRTIO_BLK_CAPACITY  0x14  // 64 bits: disk size in sectors
+
+// Device status bits.
+#define VIRTIO_ACK           1
+#define VIRTIO_DRIVER        2
+#define VIRTIO_DRIVER_OK     4
+#define VIRTIO_FAILED        128
+
+#define VRING_ALIGN          4096
+
+struct vring_desc {
+  uint addr;     // physical address; the high half stays zero
+  uint addrhi;
+  uint len;
+  ushort flags;
+  ushort next;
+};
+#define VRING_DESC_F_NEXT    1  // chained with next
+#define VRING_DESC_F_WRITE   2  // device writes (vs reads)
+
+struct vring_avail {
+  ushort flags;
+  ushort idx;
+  ushort ring[];
+};
+
+struct vring_used_elem {
+  uint id;       // head of the finished descriptor chain
+  uint len;
+};
+
+struct vring_used {
+  ushort flags;
+  ushort idx;
+  struct vring_used_elem ring[];
+};
+
+// Block request header, the first descriptor of a request.
+struct virtio_blk_req {
+  uint type;
+  uint reserved;
+  uint sector;
+  uint sectorhi;
+};
+#define VIRTIO_BLK_T_IN      0  // read
+#define VIRTIO_BLK_T_OUT     1  // write
@@ -6,8 +6,14 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "fs.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "percpu.h"
 
 extern char data[];  // defined by kernel.ld
+extern char percpustart[], percpuend[];  // template per-cpu data, kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
 
 // Set up CPU's kernel segment descriptors.
@@ -21,12 +27,39 @@ seginit(void)
   // Cannot share a CODE descriptor for both kernel and user
   // because it would have to have DPL_USR, but the CPU forbids
   // an interrupt from CPL=0 to DPL=3.
-  c = &cpus[cpuid()];
+  c = lapiccpu();
   c->gdt[SEG_KCODE] = SEG(STA_X|STA_R, 0, 0xffffffff, 0);
   c->gdt[SEG_KDATA] = SEG(STA_W, 0, 0xffffffff, 0);
   c->gdt[SEG_UCODE] = SEG(STA_X|STA_R, 0, 0xffffffff, DPL_USER);
   c->gdt[SEG_UDATA] = SEG(STA_W, 0, 0xffffffff, DPL_USER);
+
+  // Map %gs-relative addresses of per-cpu variables to this
+  // cpu's copy.  Addresses wrap around, so the base may be
+  // "negative" when the copy lies below the template.
+  c->gdt[SEG_KCPU] = SEG(STA_W, c->percpuoff, 0xffffffff, 0);
   lgdt(c->gdt, sizeof(c->gdt));
+  loadgs(SEG_KCPU << 3);
+  percpu_write(thiscpu, c);
+}
+
+// Give every cpu its own copy of the per-cpu variables,
+// initialized from the template in .data.percpu.
+// Must run after mpinit() and before seginit().
+void
+percpuinit(void)
+{
+  struct cpu *c;
+  char *p;
+
+  if(percpuend - percpustart > PGSIZE)
+    panic("percpuinit: too big");
+  for(c = cpus; c < cpus+ncpu; c++){
+    if((p = kalloc()) == 0)
+      panic("percpuinit: out of memory");
+    memset(p, 0, PGSIZE);
+    memmove(p, percpustart, percpuend - percpustart);
+    c->percpuoff = p - percpustart;
+  }
 }
 
 // Return the address of the PTE in page table pgdir
@@ -199,9 +232,12 @@ loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
 {
   uint i, pa, n;
   pte_t *pte;
+  struct rastate ra;
 
   if((uint) addr % PGSIZE != 0)
     panic("loaduvm: addr must be page aligned");
+  memset(&ra, 0, sizeof(ra));
+  ra.next = offset / BSIZE;
   for(i = 0; i < sz; i += PGSIZE){
     if((pte = walkpgdir(pgdir, addr+i, 0)) == 0)
       panic("loaduvm: address should exist");
@@ -210,6 +246,7 @@ loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
       n = sz - i;
     else
       n = PGSIZE;
+    readahead(ip, &ra, offset+i, n);
     if(readi(ip, P2V(pa), offset+i, n) != n)
       return -1;
   }
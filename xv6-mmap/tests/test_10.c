@@ -0,0 +1,50 @@
+#include "param.h"
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+#include "syscall.h"
+#include "traps.h"
+#include "memlayout.h"
+
+/*Testing sched_setaffinity/sched_getaffinity on the caller and a child.*/
+int
+main(int argc, char *argv[])
+{
+  int pid, mask;
+
+  if((mask = sched_getaffinity(0)) <= 0){
+    printf(1, "XV6_TEST_OUTPUT : sched_getaffinity failed\n");
+    exit();
+  }
+  if(sched_setaffinity(0, 0) != -1){
+    printf(1, "XV6_TEST_OUTPUT : empty mask should be rejected\n");
+    exit();
+  }
+  if(sched_setaffinity(0, 1) < 0 || sched_getaffinity(0) != 1){
+    printf(1, "XV6_TEST_OUTPUT : pinning to cpu 0 failed\n");
+    exit();
+  }
+  printf(1, "XV6_TEST_OUTPUT : pinned to cpu 0\n");
+
+  pid = fork();
+  if(pid == 0){
+    // Children inherit their parent's affinity.
+    if(sched_getaffinity(0) != 1)
+      printf(1, "XV6_TEST_OUTPUT : child did not inherit affinity\n");
+    exit();
+  }
+  wait();
+
+  if(sched_getaffinity(12345) != -1 || sched_setaffinity(12345, 1) != -1){
+    printf(1, "XV6_TEST_OUTPUT : bad pid should be rejected\n");
+    exit();
+  }
+  if(sched_setaffinity(0, mask) < 0){
+    printf(1, "XV6_TEST_OUTPUT : restoring affinity failed\n");
+    exit();
+  }
+  printf(1, "XV6_TEST_OUTPUT : affinity good\n");
+  exit();
+}
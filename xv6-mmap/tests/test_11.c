@@ -0,0 +1,50 @@
+#include "param.h"
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+#include "syscall.h"
+#include "traps.h"
+#include "memlayout.h"
+#include "procinfo.h"
+
+struct procinfo pi[64];
+struct cpuinfo ci[NCPU];
+
+/*Testing getprocinfo/getcpuinfo scheduler accounting.*/
+int
+main(int argc, char *argv[])
+{
+  int i, n, pid;
+  struct procinfo *me;
+
+  pid = getpid();
+  sleep(1);
+  if((n = getprocinfo(pi, 64)) <= 0){
+    printf(1, "XV6_TEST_OUTPUT : getprocinfo failed\n");
+    exit();
+  }
+  me = 0;
+  for(i = 0; i < n; i++)
+    if(pi[i].pid == pid)
+      me = &pi[i];
+  if(me == 0 || strcmp(me->name, "test_11") != 0){
+    printf(1, "XV6_TEST_OUTPUT : getprocinfo did not report the caller\n");
+    exit();
+  }
+  printf(1, "XV6_TEST_OUTPUT : found self\n");
+  if(me->nvcsw < 1)
+    printf(1, "XV6_TEST_OUTPUT : sleep was not counted as a voluntary switch\n");
+
+  if(getcpuinfo(ci, NCPU) < 1){
+    printf(1, "XV6_TEST_OUTPUT : getcpuinfo failed\n");
+    exit();
+  }
+  if(getprocinfo(pi, -1) != -1){
+    printf(1, "XV6_TEST_OUTPUT : negative count should be rejected\n");
+    exit();
+  }
+  printf(1, "XV6_TEST_OUTPUT : procinfo good\n");
+  exit();
+}
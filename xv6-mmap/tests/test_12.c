@@ -0,0 +1,68 @@
+#include "param.h"
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+#include "syscall.h"
+#include "traps.h"
+#include "memlayout.h"
+#include "lockstat.h"
+
+struct lockinfo li[NLOCKCLASS];
+
+// Return the counters for the lock class called name, or 0.
+struct lockinfo*
+find(int n, char *name, int type)
+{
+  int i;
+
+  for(i = 0; i < n; i++)
+    if(li[i].type == type && strcmp(li[i].name, name) == 0)
+      return &li[i];
+  return 0;
+}
+
+/*Testing the lockstat lock contention counters.*/
+int
+main(int argc, char *argv[])
+{
+  int n, fd;
+  struct lockinfo *pt;
+  char buf[16];
+
+  fd = open("README", O_RDONLY);
+  read(fd, buf, sizeof(buf));
+  close(fd);
+
+  if((n = lockstat(li, NLOCKCLASS, 0)) <= 0){
+    printf(1, "XV6_TEST_OUTPUT : lockstat failed\n");
+    exit();
+  }
+  if((pt = find(n, "ptable", LOCKSPIN)) == 0 || pt->nacquire == 0){
+    printf(1, "XV6_TEST_OUTPUT : ptable lock not counted\n");
+    exit();
+  }
+  if(pt->ncontend > pt->nacquire){
+    printf(1, "XV6_TEST_OUTPUT : more contended than total acquisitions\n");
+    exit();
+  }
+  if(find(n, "inode", LOCKSLEEP) == 0){
+    printf(1, "XV6_TEST_OUTPUT : inode sleeplock not counted\n");
+    exit();
+  }
+  printf(1, "XV6_TEST_OUTPUT : found locks\n");
+
+  lockstat(li, NLOCKCLASS, 1);
+  n = lockstat(li, NLOCKCLASS, 0);
+  if((pt = find(n, "ptable", LOCKSPIN)) == 0 || pt->nacquire > 1000){
+    printf(1, "XV6_TEST_OUTPUT : reset did not clear the counters\n");
+    exit();
+  }
+  if(lockstat(li, -1, 0) != -1){
+    printf(1, "XV6_TEST_OUTPUT : negative count should be rejected\n");
+    exit();
+  }
+  printf(1, "XV6_TEST_OUTPUT : lockstat good\n");
+  exit();
+}
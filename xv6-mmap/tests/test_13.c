@@ -0,0 +1,94 @@
+#include "param.h"
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+#include "syscall.h"
+#include "traps.h"
+#include "memlayout.h"
+
+#define NCHILD 4
+#define NITER 20
+#define FSZ 2048
+
+char data[FSZ], buf[FSZ];
+
+// Re-open and read the shared file many times, checking its content.
+int
+reader(void)
+{
+  int i, j, fd;
+  struct stat st;
+
+  for(i = 0; i < NITER; i++){
+    if((fd = open("rwdir/data", O_RDONLY)) < 0)
+      return -1;
+    if(fstat(fd, &st) < 0 || st.size != FSZ)
+      return -1;
+    if(read(fd, buf, FSZ) != FSZ)
+      return -1;
+    for(j = 0; j < FSZ; j++)
+      if(buf[j] != data[j])
+        return -1;
+    close(fd);
+  }
+  return 0;
+}
+
+// Create and remove files in the directory the readers look up in.
+int
+writer(void)
+{
+  int i, fd;
+
+  for(i = 0; i < NITER; i++){
+    if((fd = open("rwdir/tmp", O_CREATE|O_RDWR)) < 0)
+      return -1;
+    write(fd, data, 100);
+    close(fd);
+    if(unlink("rwdir/tmp") < 0)
+      return -1;
+  }
+  return 0;
+}
+
+/*Testing shared inode locks: concurrent readers with a writer.*/
+int
+main(int argc, char *argv[])
+{
+  int i, fd, pid, bad;
+
+  for(i = 0; i < FSZ; i++)
+    data[i] = 'a' + i % 26;
+  mkdir("rwdir");
+  if((fd = open("rwdir/data", O_CREATE|O_RDWR)) < 0 ||
+     write(fd, data, FSZ) != FSZ){
+    printf(1, "XV6_TEST_OUTPUT : setup failed\n");
+    exit();
+  }
+  close(fd);
+
+  for(i = 0; i <= NCHILD; i++){
+    if((pid = fork()) < 0){
+      printf(1, "XV6_TEST_OUTPUT : fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      if((i == NCHILD ? writer() : reader()) < 0)
+        printf(1, "XV6_TEST_OUTPUT : child %d saw bad data\n", i);
+      exit();
+    }
+  }
+  bad = 0;
+  for(i = 0; i <= NCHILD; i++)
+    if(wait() < 0)
+      bad = 1;
+  if(bad)
+    printf(1, "XV6_TEST_OUTPUT : wait failed\n");
+
+  unlink("rwdir/data");
+  unlink("rwdir");
+  printf(1, "XV6_TEST_OUTPUT : readers done\n");
+  exit();
+}
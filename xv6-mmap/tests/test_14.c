@@ -0,0 +1,70 @@
+#include "param.h"
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+#include "syscall.h"
+#include "traps.h"
+#include "memlayout.h"
+
+// Does path exist?
+int
+exists(char *path)
+{
+  int fd;
+
+  if((fd = open(path, O_RDONLY)) < 0)
+    return 0;
+  close(fd);
+  return 1;
+}
+
+/*Testing that cached path lookups see creates and removes.*/
+int
+main(int argc, char *argv[])
+{
+  int fd;
+
+  mkdir("dc");
+  // Cache a negative entry, then create the name.
+  if(exists("dc/f") || exists("dc/f")){
+    printf(1, "XV6_TEST_OUTPUT : dc/f exists too early\n");
+    exit();
+  }
+  if((fd = open("dc/f", O_CREATE|O_RDWR)) < 0){
+    printf(1, "XV6_TEST_OUTPUT : create failed\n");
+    exit();
+  }
+  close(fd);
+  if(!exists("dc/f") || !exists("dc/f")){
+    printf(1, "XV6_TEST_OUTPUT : negative entry not invalidated by create\n");
+    exit();
+  }
+
+  // A second name for the same file.
+  if(link("dc/f", "dc/g") < 0 || !exists("dc/g")){
+    printf(1, "XV6_TEST_OUTPUT : link failed\n");
+    exit();
+  }
+  unlink("dc/f");
+  if(exists("dc/f") || !exists("dc/g")){
+    printf(1, "XV6_TEST_OUTPUT : positive entry not invalidated by unlink\n");
+    exit();
+  }
+  unlink("dc/g");
+
+  // Remove the directory and make a new one of the same name.
+  if(unlink("dc") < 0 || exists("dc/.")){
+    printf(1, "XV6_TEST_OUTPUT : directory removal not seen\n");
+    exit();
+  }
+  mkdir("dc");
+  if(!exists("dc/.") || !exists("dc/..") || exists("dc/g")){
+    printf(1, "XV6_TEST_OUTPUT : recreated directory looks wrong\n");
+    exit();
+  }
+  unlink("dc");
+  printf(1, "XV6_TEST_OUTPUT : dcache good\n");
+  exit();
+}
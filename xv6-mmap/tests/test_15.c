@@ -0,0 +1,65 @@
+#include "param.h"
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+#include "syscall.h"
+#include "traps.h"
+#include "memlayout.h"
+#include "bcacheinfo.h"
+
+#define FSZ (2*NBUF*BSIZE)
+
+char buf[FSZ];
+
+// Read the whole file back.
+int
+readall(char *path)
+{
+  int fd, n;
+
+  if((fd = open(path, O_RDONLY)) < 0)
+    return -1;
+  n = read(fd, buf, FSZ);
+  close(fd);
+  return n;
+}
+
+/*Testing that the buffer cache grows and keeps a file larger than NBUF.*/
+int
+main(int argc, char *argv[])
+{
+  int fd, i;
+  struct bcacheinfo before, after;
+
+  if((fd = open("bigcache", O_CREATE|O_RDWR)) < 0){
+    printf(1, "XV6_TEST_OUTPUT : create failed\n");
+    exit();
+  }
+  for(i = 0; i < FSZ; i += 4096)
+    write(fd, buf, 4096);
+  close(fd);
+
+  readall("bigcache");
+  if(bcachestat(&before) < 0){
+    printf(1, "XV6_TEST_OUTPUT : bcachestat failed\n");
+    exit();
+  }
+  if(before.nbuf <= NBUF || before.nbuf > before.maxbuf){
+    printf(1, "XV6_TEST_OUTPUT : cache did not grow\n");
+    exit();
+  }
+  if(readall("bigcache") != FSZ){
+    printf(1, "XV6_TEST_OUTPUT : read failed\n");
+    exit();
+  }
+  bcachestat(&after);
+  if(after.hits - before.hits < FSZ/BSIZE)
+    printf(1, "XV6_TEST_OUTPUT : second read was not served from the cache\n");
+  if(after.misses - before.misses > 4)
+    printf(1, "XV6_TEST_OUTPUT : second read missed the cache\n");
+  unlink("bigcache");
+  printf(1, "XV6_TEST_OUTPUT : bcache good\n");
+  exit();
+}
@@ -0,0 +1,50 @@
+#include "param.h"
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+#include "syscall.h"
+#include "traps.h"
+#include "memlayout.h"
+#include "procinfo.h"
+
+struct procinfo pi[64];
+char buf[BSIZE];
+
+/*Testing sync() and fsync(), and that the log flusher thread runs.*/
+int
+main(int argc, char *argv[])
+{
+  int fd, i, n, found;
+
+  n = getprocinfo(pi, 64);
+  found = 0;
+  for(i = 0; i < n; i++)
+    if(strcmp(pi[i].name, "logflush") == 0)
+      found = 1;
+  if(!found)
+    printf(1, "XV6_TEST_OUTPUT : no logflush thread\n");
+
+  if((fd = open("synced", O_CREATE|O_RDWR)) < 0){
+    printf(1, "XV6_TEST_OUTPUT : create failed\n");
+    exit();
+  }
+  memset(buf, 'x', sizeof(buf));
+  for(i = 0; i < 8; i++)
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf))
+      printf(1, "XV6_TEST_OUTPUT : write failed\n");
+  if(fsync(fd) != 0)
+    printf(1, "XV6_TEST_OUTPUT : fsync failed\n");
+  close(fd);
+  if(fsync(fd) != -1)
+    printf(1, "XV6_TEST_OUTPUT : fsync of closed fd succeeded\n");
+  if(unlink("synced") < 0)
+    printf(1, "XV6_TEST_OUTPUT : unlink failed\n");
+  if(sync() != 0)
+    printf(1, "XV6_TEST_OUTPUT : sync failed\n");
+  if(sync() != 0)
+    printf(1, "XV6_TEST_OUTPUT : idle sync failed\n");
+  printf(1, "XV6_TEST_OUTPUT : sync good\n");
+  exit();
+}
@@ -0,0 +1,58 @@
+#include "param.h"
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+#include "syscall.h"
+#include "traps.h"
+#include "memlayout.h"
+
+#define FSZ (16*4096 + 100)
+
+char data[FSZ], buf[FSZ];
+
+/*Testing the tmpfs mounted on /tmp.*/
+int
+main(int argc, char *argv[])
+{
+  int fd, i;
+  struct stat st;
+
+  for(i = 0; i < FSZ; i++)
+    data[i] = i % 251;
+  if((fd = open("/tmp/scratch", O_CREATE|O_RDWR)) < 0){
+    printf(1, "XV6_TEST_OUTPUT : create failed\n");
+    exit();
+  }
+  if(write(fd, data, FSZ) != FSZ)
+    printf(1, "XV6_TEST_OUTPUT : write failed\n");
+  if(fstat(fd, &st) < 0 || st.dev != TMPDEV || st.size != FSZ)
+    printf(1, "XV6_TEST_OUTPUT : file not on tmpfs\n");
+  close(fd);
+
+  if((fd = open("/tmp/scratch", O_RDONLY)) < 0 || read(fd, buf, FSZ) != FSZ)
+    printf(1, "XV6_TEST_OUTPUT : read failed\n");
+  close(fd);
+  for(i = 0; i < FSZ; i++)
+    if(buf[i] != data[i]){
+      printf(1, "XV6_TEST_OUTPUT : data mismatch at %d\n", i);
+      break;
+    }
+
+  if(mkdir("/tmp/d") < 0 || chdir("/tmp/d") < 0)
+    printf(1, "XV6_TEST_OUTPUT : mkdir failed\n");
+  if(chdir("../..") < 0 || stat("init", &st) < 0 || st.dev != ROOTDEV)
+    printf(1, "XV6_TEST_OUTPUT : .. did not leave tmpfs\n");
+  if(stat("/tmp/d/../scratch", &st) < 0 || st.dev != TMPDEV)
+    printf(1, "XV6_TEST_OUTPUT : lookup through tmpfs failed\n");
+
+  if(unlink("/tmp") == 0)
+    printf(1, "XV6_TEST_OUTPUT : removed mount point\n");
+  if(unlink("/tmp/d") < 0 || unlink("/tmp/scratch") < 0)
+    printf(1, "XV6_TEST_OUTPUT : unlink failed\n");
+  if(open("/tmp/scratch", O_RDONLY) >= 0)
+    printf(1, "XV6_TEST_OUTPUT : file survived unlink\n");
+  printf(1, "XV6_TEST_OUTPUT : tmpfs good\n");
+  exit();
+}
@@ -0,0 +1,74 @@
+#include "param.h"
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+#include "syscall.h"
+#include "traps.h"
+#include "memlayout.h"
+
+// Past the blocks the direct and indirect blocks map.
+#define NBLK (NDIRECT + NINDIRECT + 16)
+
+int buf[BSIZE/sizeof(int)];
+
+// Write a file that reaches into the double-indirect blocks.
+static int
+writebig(void)
+{
+  int fd, i;
+
+  if((fd = open("big", O_CREATE|O_RDWR)) < 0)
+    return -1;
+  for(i = 0; i < NBLK; i++){
+    buf[0] = i;
+    buf[BSIZE/sizeof(int) - 1] = ~i;
+    if(write(fd, buf, BSIZE) != BSIZE){
+      close(fd);
+      return -1;
+    }
+  }
+  close(fd);
+  return 0;
+}
+
+/*Testing a file that needs double-indirect blocks.*/
+int
+main(int argc, char *argv[])
+{
+  int fd, i;
+  struct stat st;
+
+  if(writebig() < 0)
+    printf(1, "XV6_TEST_OUTPUT : write big file failed\n");
+  if(stat("big", &st) < 0 || st.size != NBLK*BSIZE)
+    printf(1, "XV6_TEST_OUTPUT : wrong size\n");
+
+  if((fd = open("big", O_RDONLY)) < 0)
+    printf(1, "XV6_TEST_OUTPUT : open big failed\n");
+  for(i = 0; i < NBLK; i++){
+    if(read(fd, buf, BSIZE) != BSIZE){
+      printf(1, "XV6_TEST_OUTPUT : read failed at block %d\n", i);
+      break;
+    }
+    if(buf[0] != i || buf[BSIZE/sizeof(int) - 1] != ~i){
+      printf(1, "XV6_TEST_OUTPUT : block %d has wrong data\n", i);
+      break;
+    }
+  }
+  if(read(fd, buf, BSIZE) != 0)
+    printf(1, "XV6_TEST_OUTPUT : read past end\n");
+  close(fd);
+
+  // Freeing the file must return all its blocks, so it
+  // can be written again.
+  if(unlink("big") < 0)
+    printf(1, "XV6_TEST_OUTPUT : unlink failed\n");
+  if(writebig() < 0)
+    printf(1, "XV6_TEST_OUTPUT : rewrite after unlink failed\n");
+  if(unlink("big") < 0)
+    printf(1, "XV6_TEST_OUTPUT : unlink failed\n");
+  printf(1, "XV6_TEST_OUTPUT : big file good\n");
+  exit();
+}
@@ -0,0 +1,63 @@
+#include "param.h"
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+#include "syscall.h"
+#include "traps.h"
+#include "memlayout.h"
+
+#define NTHREAD 4
+#define NITER 1000
+
+lock_t lock;
+int counter;
+int seen[NTHREAD];
+
+void
+worker(void *arg1, void *arg2)
+{
+  int i, id = (int)arg1;
+
+  for(i = 0; i < NITER; i++){
+    lock_acquire(&lock);
+    counter++;
+    lock_release(&lock);
+  }
+  seen[id] = (int)arg2;
+  exit();
+}
+
+/*Testing clone/join: threads share memory with their creator.*/
+int
+main(int argc, char *argv[])
+{
+  int i, pid;
+
+  lock_init(&lock);
+  for(i = 0; i < NTHREAD; i++){
+    if(thread_create(worker, (void*)i, (void*)(i + 100)) < 0){
+      printf(1, "XV6_TEST_OUTPUT : thread_create failed\n");
+      exit();
+    }
+  }
+  for(i = 0; i < NTHREAD; i++){
+    if((pid = thread_join()) < 0){
+      printf(1, "XV6_TEST_OUTPUT : thread_join failed\n");
+      exit();
+    }
+  }
+  if(thread_join() != -1){
+    printf(1, "XV6_TEST_OUTPUT : thread_join with no threads should fail\n");
+    exit();
+  }
+
+  printf(1, "XV6_TEST_OUTPUT : counter = %d\n", counter);
+  for(i = 0; i < NTHREAD; i++)
+    if(seen[i] != i + 100)
+      printf(1, "XV6_TEST_OUTPUT : thread %d did not run\n", i);
+
+  printf(1, "XV6_TEST_OUTPUT : clone and join good\n");
+  exit();
+}
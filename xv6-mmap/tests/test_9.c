@@ -0,0 +1,79 @@
+#include "param.h"
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+#include "syscall.h"
+#include "traps.h"
+#include "memlayout.h"
+
+#define NITEM 100
+
+mutex_t m;
+cond_t nonempty, nonfull;
+int slot, full, sum;
+
+void
+producer(void *arg1, void *arg2)
+{
+  int i;
+
+  for(i = 1; i <= NITEM; i++){
+    mutex_lock(&m);
+    while(full)
+      cond_wait(&nonfull, &m);
+    slot = i;
+    full = 1;
+    cond_signal(&nonempty);
+    mutex_unlock(&m);
+  }
+  exit();
+}
+
+void
+consumer(void *arg1, void *arg2)
+{
+  int i;
+
+  for(i = 1; i <= NITEM; i++){
+    mutex_lock(&m);
+    while(!full)
+      cond_wait(&nonempty, &m);
+    sum += slot;
+    full = 0;
+    cond_signal(&nonfull);
+    mutex_unlock(&m);
+  }
+  exit();
+}
+
+/*Testing futex-based mutexes and condition variables between threads.*/
+int
+main(int argc, char *argv[])
+{
+  uint word = 7;
+
+  if(futex_wait(&word, 8) != -1){
+    printf(1, "XV6_TEST_OUTPUT : futex_wait should fail on a changed value\n");
+    exit();
+  }
+  if(futex_wake(&word, 1) != 0){
+    printf(1, "XV6_TEST_OUTPUT : futex_wake woke a process from nowhere\n");
+    exit();
+  }
+
+  mutex_init(&m);
+  cond_init(&nonempty);
+  cond_init(&nonfull);
+  if(thread_create(consumer, 0, 0) < 0 || thread_create(producer, 0, 0) < 0){
+    printf(1, "XV6_TEST_OUTPUT : thread_create failed\n");
+    exit();
+  }
+  thread_join();
+  thread_join();
+
+  printf(1, "XV6_TEST_OUTPUT : sum = %d\n", sum);
+  printf(1, "XV6_TEST_OUTPUT : futex good\n");
+  exit();
+}